@@ -0,0 +1,155 @@
+#include "animation.h"
+#include <stdlib.h>
+#include <string.h>
+#include "gifdecoder.h"
+#include "mappedfile.h"
+
+std::thread Animation::_worker;
+std::mutex Animation::_mutex;
+std::condition_variable Animation::_cond;
+AnimationFrame Animation::_ring[ANIMATION_RING];
+int Animation::_head = 0;
+int Animation::_count = 0;
+bool Animation::_running = false;
+bool Animation::_decoding = false;
+unsigned int Animation::_id = 0;
+time_t Animation::_mtime = 0;
+double Animation::_next_frame = 0;
+
+/*
+ * Called every frame with the entry in slide view (NULL in grid view). Starts playback when a GIF comes
+ * on screen, stops it when it leaves (or the file changes) and shows the next frame once it is due.
+ */
+void Animation::update(RenderImage* entry) {
+    if (entry == NULL || entry->format != FileFormat::GIF) {
+        Animation::stop();
+        return;
+    }
+    if (!Animation::playing() || entry->id != _id || entry->mtime != _mtime)
+        Animation::start(*entry);
+
+    // Frames wait while the first one is still being decoded, or the texture was evicted.
+    double now = GetTime();
+    if (entry->state != TextureState::READY) {
+        _next_frame = now;
+        return;
+    }
+    if (now < _next_frame)
+        return;
+
+    AnimationFrame* frame;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_count == 0)
+            return;
+        frame = &_ring[_head];
+    }
+
+    auto& texture = entry->image;
+    if (texture.width == frame->image.width && texture.height == frame->image.height && texture.format == frame->image.format) {
+        UpdateTexture(texture, frame->image.data);
+        // UpdateTexture only replaces the base level, the chain is rebuilt on the GPU.
+        if (texture.mipmaps > 1)
+            GenTextureMipmaps(&texture);
+    }
+
+    // A frame that is late (a slow decode, a stalled loop) does not make the next ones rush to catch up.
+    _next_frame += frame->delay;
+    if (_next_frame < now)
+        _next_frame = now + frame->delay;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _head = (_head + 1) % ANIMATION_RING;
+        _count--;
+    }
+    _cond.notify_one();
+}
+
+void Animation::start(RenderImage& entry) {
+    Animation::stop();
+    _id = entry.id;
+    _mtime = entry.mtime;
+    _next_frame = GetTime();
+    _running = true;
+    _decoding = true;
+    _worker = std::thread(Animation::worker, strdup(entry.source()));
+}
+
+void Animation::stop() {
+    if (!Animation::playing())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_all();
+    _worker.join();
+
+    for (auto& frame: _ring) {
+        UnloadImage(frame.image);
+        frame = {0};
+    }
+    _head = 0;
+    _count = 0;
+}
+
+/*
+ * Whether there are frames left to show: the worker still decodes (it loops GIFs with more than one
+ * frame until stopped) or decoded frames wait in the ring. False once a single frame or broken GIF is done.
+ */
+bool Animation::has_frames() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _decoding || _count > 0;
+}
+
+/*
+ * Decodes frames into the free slots of the ring, waiting while it is full. Only the slot past the
+ * queued frames is written, the render loop reads the one at the head, so neither needs the lock while copying.
+ */
+void Animation::worker(char* path) {
+    MappedFile file;
+    GifDecoder decoder;
+    if (!file.open(path) || !decoder.open(file.data(), file.size())) {
+        file.close();
+        free(path);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _decoding = false;
+        return;
+    }
+
+    while (true) {
+        float delay;
+        if (!decoder.next(&delay)) {
+            // A GIF with a single frame has nothing to play.
+            if (decoder.frame() <= 1)
+                break;
+            decoder.rewind();
+            continue;
+        }
+
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, []() { return !_running || _count < ANIMATION_RING; });
+            if (!_running)
+                break;
+            slot = (_head + _count) % ANIMATION_RING;
+        }
+
+        auto canvas = decoder.canvas();
+        auto& frame = _ring[slot];
+        if (frame.image.data == NULL)
+            frame.image = ImageCopy(canvas);
+        else
+            memcpy(frame.image.data, canvas.data, GetPixelDataSize(canvas.width, canvas.height, canvas.format));
+        frame.delay = delay;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _count++;
+    }
+    file.close();
+    free(path);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _decoding = false;
+}
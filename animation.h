@@ -0,0 +1,65 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <raylib.h>
+#include <time.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "renderimage.h"
+
+/*
+ * Number of decoded frames waiting for their turn. Decoding stays this far ahead of playback, which
+ * bounds the memory of a GIF with thousands of frames to a handful of canvases.
+ */
+const int ANIMATION_RING = 4;
+
+/*
+ * AnimationFrame struct.
+ * A decoded frame in the ring and how long it stays on screen in seconds.
+ */
+struct AnimationFrame {
+    Image image;
+    float delay;
+};
+
+/*
+ * Animation struct.
+ * Plays the animated GIF shown in slide view. A worker thread decodes frame after frame (looping at the
+ * end) into a small ring, the render loop copies each frame into the entry's texture with UpdateTexture
+ * once the previous one has been on screen for its delay. The texture itself is the one the ImageLoader
+ * made from the first frame, so nothing new is allocated on the GPU.
+ */
+struct Animation {
+public:
+    static void update(RenderImage* entry);
+    static void stop();
+    static bool playing() { return _worker.joinable(); }
+    static bool has_frames();
+
+private:
+    static void start(RenderImage& entry);
+    static void worker(char* path);
+
+    static std::thread _worker;
+    static std::mutex _mutex;
+    static std::condition_variable _cond;
+    static AnimationFrame _ring[ANIMATION_RING];
+    static int _head;
+    static int _count;
+    static bool _running;
+    static bool _decoding;
+    static unsigned int _id;
+    static time_t _mtime;
+    static double _next_frame;
+};
+
+#endif // ANIMATION_H
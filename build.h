@@ -11,10 +11,36 @@
 "popupmenu.cpp\n"\
 "renderimage.cpp\n"\
 "ryi.cpp\n"\
+"imageloader.cpp\n"\
+"texturecache.cpp\n"\
+"prefetcher.cpp\n"\
+"thumbnailcache.cpp\n"\
+"mappedfile.cpp\n"\
+"imageprobe.cpp\n"\
+"jpegdecoder.cpp\n"\
+"progressivedecoder.cpp\n"\
+"dirscanner.cpp\n"\
+"uring.cpp\n"\
+"dirwatcher.cpp\n"\
+"fileformat.cpp\n"\
+"catalogsort.cpp\n"\
+"gifdecoder.cpp\n"\
+"animation.cpp\n"\
+"deepzoom.cpp\n"\
+"texturecodec.cpp\n"\
+"pixelbuffers.cpp\n"\
+"framequeue.cpp\n"\
+"uploadthread.cpp\n"\
+"texturepool.cpp\n"\
+"idle.cpp\n"\
 "tinyfiledialogs.c\n"\
 "-o\n"\
 "ryi\n"\
 "-lraylib\n"\
-"-lcurl\n"
+"-lcurl\n"\
+"-ljpeg\n"\
+"-lpng\n"\
+"-lGL\n"\
+"-pthread\n"
 
 #endif //__BUILD_DATE__
@@ -0,0 +1,229 @@
+#include "catalogsort.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Below this many entries a single std::sort beats starting threads.
+const size_t SORT_PARALLEL_MIN = 65536;
+const int SORT_MAX_THREADS = 8;
+// Digit runs of this many significant digits and more get a multi-byte count in natural keys.
+const size_t NATURAL_LONG_RUN = 15;
+
+/*
+ * Builds the natural order key of `path`: letters lowercased, every run of digits replaced by its
+ * significant digits behind their count, so longer numbers sort after shorter ones. Counts below
+ * NATURAL_LONG_RUN are one byte below any printable character, longer ones (ns timestamps, long frame ids)
+ * are NATURAL_LONG_RUN's byte, the number of bytes the count takes and the count in base 255.
+ * Path separators become 0x01, a directory's files stay together.
+ */
+char* CatalogSort::natural_key(const char* path) {
+    size_t length = strlen(path);
+    char* key = (char*)malloc(length * 2 + 1);
+    size_t out = 0;
+    for (size_t i = 0; i < length; ) {
+        char c = path[i];
+        if (c >= '0' && c <= '9') {
+            while (path[i] == '0')
+                i++;
+            size_t start = i;
+            while (path[i] >= '0' && path[i] <= '9')
+                i++;
+            size_t digits = i - start;
+            key[out++] = (char)(0x10 + (digits < NATURAL_LONG_RUN ? digits : NATURAL_LONG_RUN));
+            if (digits >= NATURAL_LONG_RUN) {
+                // Base 255 digits shifted up by one, a key holds no zero bytes.
+                unsigned char count[sizeof(size_t) + 1];
+                int bytes = 0;
+                for (size_t rest = digits; rest > 0; rest /= 255)
+                    count[bytes++] = (unsigned char)(rest % 255 + 1);
+                key[out++] = (char)bytes;
+                while (bytes > 0)
+                    key[out++] = (char)count[--bytes];
+            }
+            memcpy(key + out, path + start, digits);
+            out += digits;
+            continue;
+        }
+
+        if (c == '/') c = 0x01;
+        else if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        key[out++] = c;
+        i++;
+    }
+    key[out] = '\0';
+    return key;
+}
+
+/*
+ * Packs the next 8 bytes of `key` big endian (zero padded), so comparing prefixes is comparing bytes,
+ * and moves `key` past them.
+ */
+static unsigned long long key_prefix(const char*& key) {
+    unsigned long long prefix = 0;
+    for (int i = 0; i < 8; i++) {
+        prefix <<= 8;
+        if (*key != '\0')
+            prefix |= (unsigned char)*key++;
+    }
+    return prefix;
+}
+
+/*
+ * Length of the part all keys share. Catalogs are mostly one tree, so the keys start with the same
+ * directories, skipping those leaves the prefixes for the part that actually differs.
+ */
+static size_t common_length(std::vector<RenderImage>& images) {
+    if (images.empty())
+        return 0;
+    const char* first = images[0].sort_key;
+    size_t length = strlen(first);
+    for (size_t i = 1; i < images.size() && length > 0; i++) {
+        const char* key = images[i].sort_key;
+        size_t same = 0;
+        while (same < length && key[same] == first[same])
+            same++;
+        length = same;
+    }
+    return length;
+}
+
+static unsigned long long key_primary(RenderImage& image, SortMode mode) {
+    switch (mode) {
+    case SortMode::MTIME: return (unsigned long long)image.mtime;
+    case SortMode::SIZE: return (unsigned long long)image.file_size;
+    case SortMode::DIMENSIONS: return (unsigned long long)image.width * image.height;
+    // Files without EXIF go by their modification time, which is usually close.
+    case SortMode::CAPTURE_TIME: return (unsigned long long)(image.capture_time != 0 ? image.capture_time : image.mtime);
+    default: return 0;
+    }
+}
+
+static bool key_less(const SortKey& a, const SortKey& b) {
+    if (a.primary != b.primary) return a.primary < b.primary;
+    if (a.prefix[0] != b.prefix[0]) return a.prefix[0] < b.prefix[0];
+    if (a.prefix[1] != b.prefix[1]) return a.prefix[1] < b.prefix[1];
+    int order = strcmp(a.key, b.key);
+    if (order != 0) return order < 0;
+    return a.index < b.index;
+}
+
+/*
+ * Sorts `keys` with up to SORT_MAX_THREADS threads: every thread sorts a chunk, then neighbouring
+ * chunks are merged pairwise, each level's merges again in parallel.
+ */
+static int sort_threads(size_t count) {
+    int threads = (int)std::thread::hardware_concurrency();
+    if (threads > SORT_MAX_THREADS) threads = SORT_MAX_THREADS;
+    return count < SORT_PARALLEL_MIN || threads < 2 ? 1 : threads;
+}
+
+/*
+ * Runs `work` over [0, count) split into one range per thread.
+ */
+template <typename Work>
+static void parallel_for(size_t count, Work work) {
+    int threads = sort_threads(count);
+    if (threads == 1) {
+        work(0, count);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(work, count * i / threads, count * (i + 1) / threads);
+    for (auto& worker: workers)
+        worker.join();
+}
+
+static void parallel_sort(std::vector<SortKey>& keys) {
+    int threads = sort_threads(keys.size());
+    if (threads == 1) {
+        std::sort(keys.begin(), keys.end(), key_less);
+        return;
+    }
+
+    std::vector<size_t> bounds;
+    for (int i = 0; i <= threads; i++)
+        bounds.push_back(keys.size() * i / threads);
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back([&keys, &bounds, i]() {
+            std::sort(keys.begin() + bounds[i], keys.begin() + bounds[i + 1], key_less);
+        });
+    for (auto& worker: workers)
+        worker.join();
+
+    std::vector<SortKey> buffer(keys.size());
+    std::vector<SortKey>* from = &keys;
+    std::vector<SortKey>* to = &buffer;
+    while (bounds.size() > 2) {
+        std::vector<size_t> merged;
+        workers.clear();
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            size_t begin = bounds[i];
+            size_t middle = bounds[i + 1];
+            size_t end = i + 2 < bounds.size() ? bounds[i + 2] : middle;
+            merged.push_back(begin);
+            workers.emplace_back([from, to, begin, middle, end]() {
+                std::merge(from->begin() + begin, from->begin() + middle, from->begin() + middle, from->begin() + end, to->begin() + begin, key_less);
+            });
+        }
+        merged.push_back(keys.size());
+        for (auto& worker: workers)
+            worker.join();
+        bounds.swap(merged);
+        std::swap(from, to);
+    }
+    if (from != &keys)
+        keys.swap(buffer);
+}
+
+/*
+ * Reorders `images` and returns how long that took in seconds.
+ */
+double CatalogSort::sort(std::vector<RenderImage>& images, SortMode mode) {
+    auto start = std::chrono::steady_clock::now();
+    for (auto& image: images) {
+        if (image.sort_key == NULL)
+            image.sort_key = CatalogSort::natural_key(image.path);
+    }
+
+    size_t common = common_length(images);
+    std::vector<SortKey> keys(images.size());
+    parallel_for(images.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            auto& image = images[i];
+            const char* key = image.sort_key + common;
+            keys[i].primary = key_primary(image, mode);
+            keys[i].prefix[0] = key_prefix(key);
+            keys[i].prefix[1] = key_prefix(key);
+            keys[i].key = key;
+            keys[i].index = (unsigned int)i;
+        }
+    });
+    parallel_sort(keys);
+
+    std::vector<RenderImage> sorted(images.size());
+    parallel_for(keys.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            sorted[i] = images[keys[i].index];
+    });
+    images.swap(sorted);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+const char* CatalogSort::name(SortMode mode) {
+    switch (mode) {
+    case SortMode::NAME: return "name";
+    case SortMode::MTIME: return "modified";
+    case SortMode::SIZE: return "size";
+    case SortMode::DIMENSIONS: return "dimensions";
+    case SortMode::CAPTURE_TIME: return "capture time";
+    default: return "";
+    }
+}
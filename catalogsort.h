@@ -0,0 +1,48 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef CATALOGSORT_H
+#define CATALOGSORT_H
+
+#include <vector>
+#include "renderimage.h"
+
+enum class SortMode {
+    NAME = 0,
+    MTIME,
+    SIZE,
+    DIMENSIONS,
+    CAPTURE_TIME,
+};
+
+/*
+ * SortKey struct.
+ * What the sort compares, built once per entry before sorting: a 64 bit value for the sort mode,
+ * 16 bytes of the natural name key past the part every key shares (most ties end there) and the rest of the key.
+ */
+struct SortKey {
+    unsigned long long primary;
+    unsigned long long prefix[2];
+    const char* key;
+    unsigned int index;
+};
+
+/*
+ * CatalogSort struct.
+ * Orders the catalog. Names sort naturally (`frame_9` before `frame_10`, case ignored) through a key
+ * that compares with plain byte order, so no comparison parses anything. Big catalogs are sorted in
+ * chunks on several threads and merged. Entries move, their ids and textures stay as they are.
+ */
+struct CatalogSort {
+public:
+    static char* natural_key(const char* path);
+    static double sort(std::vector<RenderImage>& images, SortMode mode);
+    static const char* name(SortMode mode);
+};
+
+#endif // CATALOGSORT_H
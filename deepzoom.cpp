@@ -0,0 +1,507 @@
+#include "deepzoom.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <jpeglib.h>
+#include <png.h>
+#include "fileformat.h"
+#include "mappedfile.h"
+#include "texturepool.h"
+
+std::thread DeepZoom::_worker;
+std::atomic<bool> DeepZoom::_running(false);
+std::atomic<bool> DeepZoom::_ready(false);
+std::atomic<bool> DeepZoom::_failed(false);
+std::atomic<bool> DeepZoom::_tiling(false);
+bool DeepZoom::_settled = true;
+std::atomic<int> DeepZoom::_rows[TILE_MAX_LEVELS];
+std::vector<TileLevel> DeepZoom::_levels;
+std::vector<std::vector<unsigned char>> DeepZoom::_pending;
+std::vector<std::vector<unsigned char>> DeepZoom::_half;
+unsigned char* DeepZoom::_map = nullptr;
+size_t DeepZoom::_map_size = 0;
+int DeepZoom::_channels = 0;
+unsigned int DeepZoom::_id = 0;
+time_t DeepZoom::_mtime = 0;
+std::unordered_map<unsigned long long, TileSlot> DeepZoom::_tiles;
+unsigned long DeepZoom::_frame = 0;
+
+bool DeepZoom::wants(int width, int height) {
+    return width > TILED_MIN_SIZE || height > TILED_MIN_SIZE || (long)width * height > TILED_MIN_PIXELS;
+}
+
+/*
+ * Called every frame with the entry in slide view (NULL in grid view). Starts tiling an image that
+ * needs it when it comes on screen and drops the pyramid when it leaves (or the file changes).
+ */
+void DeepZoom::update(RenderImage* entry) {
+    if (entry == NULL || !entry->tiled()) {
+        DeepZoom::stop();
+        return;
+    }
+    if (!DeepZoom::active() || entry->id != _id || entry->mtime != _mtime)
+        DeepZoom::start(*entry);
+}
+
+void DeepZoom::start(RenderImage& entry) {
+    DeepZoom::stop();
+    _id = entry.id;
+    _mtime = entry.mtime;
+    _ready = false;
+    _failed = false;
+    _running = true;
+    _tiling = true;
+    _worker = std::thread(DeepZoom::worker, strdup(entry.source()));
+}
+
+void DeepZoom::stop() {
+    if (!DeepZoom::active())
+        return;
+    _running = false;
+    _worker.join();
+
+    for (auto& tile: _tiles)
+        TexturePool::release(tile.second.texture);
+    _tiles.clear();
+    if (_map != nullptr)
+        munmap(_map, _map_size);
+    _map = nullptr;
+    _map_size = 0;
+    _levels.clear();
+    _pending.clear();
+    _half.clear();
+    _ready = false;
+}
+
+size_t DeepZoom::bytes() {
+    return _tiles.size() * TILE_SIZE * TILE_SIZE * _channels;
+}
+
+/*
+ * How much of the image has been read, from 0 to 1.
+ */
+float DeepZoom::progress() {
+    if (!_ready)
+        return 0;
+    return (float)_rows[0].load(std::memory_order_acquire) / _levels[0].height;
+}
+
+void DeepZoom::worker(char* path) {
+    MappedFile file;
+    bool tiled = false;
+    if (file.open(path)) {
+        auto format = FileFormats::from_magic(file.data(), file.size());
+        if (format == FileFormat::JPEG)
+            tiled = DeepZoom::tile_jpeg(file.data(), file.size());
+        else if (format == FileFormat::PNG)
+            tiled = DeepZoom::tile_png(file.data(), file.size());
+        else
+            TraceLog(LOG_WARNING, "RYI: `%s` is too large to draw and only JPEG and PNG images can be tiled", path);
+        file.close();
+    }
+
+    if (!tiled && _running)
+        _failed = true;
+    free(path);
+    _tiling = false;
+}
+
+/*
+ * Lays the pyramid out in a temporary file: levels halve until one tile holds the whole image, every
+ * tile is stored at full TILE_SIZE (edge tiles padded) so a tile is a single upload straight from the mapping.
+ * The space is reserved up front, a full disk fails here instead of with a SIGBUS mid write. The file is
+ * created in $TMPDIR, or /var/tmp, which unlike /tmp is rarely a RAM backed tmpfs.
+ */
+bool DeepZoom::layout(int width, int height, int channels) {
+    _levels.clear();
+    size_t offset = 0;
+    size_t tile_bytes = (size_t)TILE_SIZE * TILE_SIZE * channels;
+    int level_width = width;
+    int level_height = height;
+    while ((int)_levels.size() < TILE_MAX_LEVELS) {
+        TileLevel level = {
+            .width = level_width,
+            .height = level_height,
+            .columns = (level_width + TILE_SIZE - 1) / TILE_SIZE,
+            .rows = (level_height + TILE_SIZE - 1) / TILE_SIZE,
+            .offset = offset,
+        };
+        offset += (size_t)level.columns * level.rows * tile_bytes;
+        _levels.push_back(level);
+        if (level_width <= TILE_SIZE && level_height <= TILE_SIZE)
+            break;
+        level_width = (level_width + 1) / 2;
+        level_height = (level_height + 1) / 2;
+    }
+
+    const char* dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/ryi-tiles-XXXXXX", dir != NULL && *dir != '\0' ? dir : "/var/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        TraceLog(LOG_WARNING, "RYI: Failed to create the tile file `%s`", path);
+        return false;
+    }
+    unlink(path);
+    if (posix_fallocate(fd, 0, offset) != 0) {
+        TraceLog(LOG_WARNING, "RYI: Not enough space for %.1f MB of tiles in `%s`", offset / (1024.0 * 1024.0), path);
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    _map = (unsigned char*)map;
+    _map_size = offset;
+    _channels = channels;
+    _pending.assign(_levels.size(), {});
+    _half.assign(_levels.size(), {});
+    for (auto& rows: _rows)
+        rows.store(0, std::memory_order_relaxed);
+    _ready.store(true, std::memory_order_release);
+    TraceLog(LOG_INFO, "RYI: Tiling %dx%d in %zu levels (%.1f MB)", width, height, _levels.size(), offset / (1024.0 * 1024.0));
+    return true;
+}
+
+unsigned char* DeepZoom::tile_data(int level, int column, int row) {
+    auto& info = _levels[level];
+    size_t tile_bytes = (size_t)TILE_SIZE * TILE_SIZE * _channels;
+    return _map + info.offset + ((size_t)row * info.columns + column) * tile_bytes;
+}
+
+/*
+ * Rows of a tile that have been written so far.
+ */
+int DeepZoom::tile_rows(int level, int row) {
+    int written = _rows[level].load(std::memory_order_acquire) - row * TILE_SIZE;
+    int height = std::min(TILE_SIZE, _levels[level].height - row * TILE_SIZE);
+    return std::max(0, std::min(written, height));
+}
+
+/*
+ * Appends the next row of `level` to its tiles. Every second row is averaged (2x2 box) with the one
+ * before it into the next row of the level above, so the whole pyramid grows in one pass.
+ */
+void DeepZoom::push_row(int level, const unsigned char* row) {
+    auto& info = _levels[level];
+    int y = _rows[level].load(std::memory_order_relaxed);
+    size_t tile_stride = (size_t)TILE_SIZE * _channels;
+    for (int column = 0; column < info.columns; column++) {
+        int pixels = std::min(TILE_SIZE, info.width - column * TILE_SIZE);
+        memcpy(tile_data(level, column, y / TILE_SIZE) + (y % TILE_SIZE) * tile_stride, row + column * tile_stride, (size_t)pixels * _channels);
+    }
+    _rows[level].store(y + 1, std::memory_order_release);
+
+    if (level + 1 >= (int)_levels.size())
+        return;
+
+    size_t stride = (size_t)info.width * _channels;
+    auto& pending = _pending[level];
+    bool last = y == info.height - 1;
+    if (y % 2 == 0 && !last) {
+        pending.assign(row, row + stride);
+        return;
+    }
+
+    // An odd height leaves the last row alone, it is averaged with itself.
+    const unsigned char* above = y % 2 == 0 ? row : pending.data();
+    auto& half = _half[level];
+    int width = _levels[level + 1].width;
+    half.resize((size_t)width * _channels);
+    for (int x = 0; x < width; x++) {
+        int left = 2 * x * _channels;
+        int right = std::min(2 * x + 1, info.width - 1) * _channels;
+        for (int c = 0; c < _channels; c++)
+            half[x * _channels + c] = (unsigned char)((above[left + c] + above[right + c] + row[left + c] + row[right + c] + 2) / 4);
+    }
+    DeepZoom::push_row(level + 1, half.data());
+}
+
+struct TileJpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void tile_jpeg_error_exit(j_common_ptr info) {
+    longjmp(((TileJpegError*)info->err)->jump, 1);
+}
+
+static void tile_jpeg_output_message(j_common_ptr) {
+}
+
+bool DeepZoom::tile_jpeg(const unsigned char* data, size_t size) {
+    jpeg_decompress_struct info;
+    TileJpegError error;
+    unsigned char* volatile row = NULL;
+
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = tile_jpeg_error_exit;
+    error.manager.output_message = tile_jpeg_output_message;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        free(row);
+        return false;
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, data, size);
+    jpeg_read_header(&info, TRUE);
+    if (info.jpeg_color_space == JCS_CMYK || info.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&info);
+    if (!DeepZoom::layout(info.output_width, info.output_height, 3)) {
+        jpeg_destroy_decompress(&info);
+        return false;
+    }
+
+    row = (unsigned char*)malloc((size_t)info.output_width * 3);
+    while (info.output_scanline < info.output_height && _running) {
+        JSAMPROW rows[1] = {row};
+        jpeg_read_scanlines(&info, rows, 1);
+        DeepZoom::push_row(0, row);
+    }
+    jpeg_destroy_decompress(&info);
+    free(row);
+    return true;
+}
+
+struct TilePngSource {
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+};
+
+static void tile_png_read(png_structp png, png_bytep out, png_size_t length) {
+    auto source = (TilePngSource*)png_get_io_ptr(png);
+    if (length > source->size - source->offset)
+        png_error(png, "truncated");
+    memcpy(out, source->data + source->offset, length);
+    source->offset += length;
+}
+
+static void tile_png_warning(png_structp, png_const_charp) {
+}
+
+/*
+ * Reads the PNG one row at a time. Interlaced files would need the whole image in memory before
+ * the first full row exists, those are refused.
+ */
+bool DeepZoom::tile_png(const unsigned char* data, size_t size) {
+    TilePngSource source = {.data = data, .size = size, .offset = 0};
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, tile_png_warning);
+    png_infop info = png != NULL ? png_create_info_struct(png) : NULL;
+    unsigned char* volatile row = NULL;
+    if (info == NULL) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        free(row);
+        return false;
+    }
+
+    png_set_read_fn(png, &source, tile_png_read);
+    png_read_info(png, info);
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+        TraceLog(LOG_WARNING, "RYI: Interlaced PNGs can not be tiled");
+        png_destroy_read_struct(&png, &info, NULL);
+        return false;
+    }
+
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_read_update_info(png, info);
+    int width = png_get_image_width(png, info);
+    int height = png_get_image_height(png, info);
+    if (!DeepZoom::layout(width, height, png_get_channels(png, info))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        return false;
+    }
+
+    row = (unsigned char*)malloc(png_get_rowbytes(png, info));
+    for (int y = 0; y < height && _running; y++) {
+        png_read_row(png, row, NULL);
+        DeepZoom::push_row(0, row);
+    }
+    png_destroy_read_struct(&png, &info, NULL);
+    free(row);
+    return true;
+}
+
+/*
+ * The texture of a tile, uploaded (or updated with the rows written since) when the frame's upload budget
+ * allows. Returns NULL while nothing of it can be drawn.
+ */
+TileSlot* DeepZoom::tile(int level, int column, int row, int& uploads) {
+    unsigned long long key = ((unsigned long long)level << 48) | ((unsigned long long)row << 24) | (unsigned long long)column;
+    int rows = DeepZoom::tile_rows(level, row);
+    auto found = _tiles.find(key);
+    if (found != _tiles.end()) {
+        auto& slot = found->second;
+        slot.frame = _frame;
+        if (slot.rows < rows && uploads < TILE_UPLOADS_PER_FRAME) {
+            UpdateTexture(slot.texture, tile_data(level, column, row));
+            slot.rows = rows;
+            uploads++;
+        }
+        return &slot;
+    }
+
+    if (rows == 0 || uploads >= TILE_UPLOADS_PER_FRAME)
+        return NULL;
+
+    Image image = {
+        .data = tile_data(level, column, row),
+        .width = TILE_SIZE,
+        .height = TILE_SIZE,
+        .mipmaps = 1,
+        .format = _channels == 4 ? PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 : PIXELFORMAT_UNCOMPRESSED_R8G8B8,
+    };
+    // Every tile has the same size, panning mostly rewrites textures of tiles that scrolled away.
+    TileSlot slot = {.texture = TexturePool::acquire(TILE_SIZE, TILE_SIZE, image.format, 1), .rows = rows, .frame = _frame};
+    if (slot.texture.id != 0)
+        UpdateTexture(slot.texture, image.data);
+    else
+        slot.texture = LoadTextureFromImage(image);
+    SetTextureFilter(slot.texture, TEXTURE_FILTER_BILINEAR);
+    SetTextureWrap(slot.texture, TEXTURE_WRAP_CLAMP);
+    uploads++;
+    return &(_tiles[key] = slot);
+}
+
+/*
+ * Unloads the tiles drawn longest ago once there are more than TILE_CACHE_TILES, never one drawn this frame.
+ */
+void DeepZoom::trim() {
+    if ((int)_tiles.size() <= TILE_CACHE_TILES)
+        return;
+
+    std::vector<std::pair<unsigned long, unsigned long long>> candidates;
+    for (auto& tile: _tiles) {
+        if (tile.second.frame != _frame)
+            candidates.push_back({tile.second.frame, tile.first});
+    }
+    size_t excess = std::min(candidates.size(), _tiles.size() - TILE_CACHE_TILES);
+    std::nth_element(candidates.begin(), candidates.begin() + excess, candidates.end());
+    for (size_t i = 0; i < excess; i++) {
+        auto tile = _tiles.find(candidates[i].second);
+        TexturePool::release(tile->second.texture);
+        _tiles.erase(tile);
+    }
+}
+
+/*
+ * Draws `entry` stretched over `rect` and rotated about its corner, like a plain texture would be.
+ * Picks the coarsest level that still has a pixel per screen pixel and walks the tiles that cover
+ * the window. A tile that is missing or only partly written is covered by the nearest coarser one first.
+ * Returns false while there is nothing to draw yet.
+ */
+bool DeepZoom::draw(RenderImage& entry, Rectangle rect, float rotation) {
+    if (entry.id != _id || !_ready.load(std::memory_order_acquire))
+        return false;
+    _frame++;
+
+    float width = _levels[0].width;
+    float height = _levels[0].height;
+    float scale_x = rect.width / width;
+    float scale_y = rect.height / height;
+    float detail = fmaxf(scale_x, scale_y);
+    int level = 0;
+    while (level + 1 < (int)_levels.size() && detail * (1 << (level + 1)) <= 1.0f)
+        level++;
+
+    // The window's corners in image pixels, undoing the rotation about the rect's corner.
+    float radians = -rotation * DEG2RAD;
+    float cosine = cosf(radians);
+    float sine = sinf(radians);
+    float corners[4][2] = {{0, 0}, {(float)GetScreenWidth(), 0}, {0, (float)GetScreenHeight()}, {(float)GetScreenWidth(), (float)GetScreenHeight()}};
+    float left = width, top = height, right = 0, bottom = 0;
+    for (auto& corner: corners) {
+        float x = corner[0] - rect.x;
+        float y = corner[1] - rect.y;
+        float u = (x * cosine - y * sine) / scale_x;
+        float v = (x * sine + y * cosine) / scale_y;
+        left = fminf(left, u);
+        right = fmaxf(right, u);
+        top = fminf(top, v);
+        bottom = fmaxf(bottom, v);
+    }
+    left = fmaxf(left, 0);
+    top = fmaxf(top, 0);
+    right = fminf(right, width);
+    bottom = fminf(bottom, height);
+    if (left >= right || top >= bottom)
+        return true;
+
+    // Draws the part `source` (in pixels of the tile's level) of a tile over the image area `region`.
+    auto draw_part = [&](TileSlot& slot, Rectangle source, Rectangle region) {
+        DrawTexturePro(
+            slot.texture,
+            source,
+            {rect.x, rect.y, region.width * scale_x, region.height * scale_y},
+            {-region.x * scale_x, -region.y * scale_y},
+            rotation,
+            WHITE
+        );
+    };
+
+    int uploads = 0;
+    auto& info = _levels[level];
+    float to_level_x = info.width / width;
+    float to_level_y = info.height / height;
+    int first_column = (int)(left * to_level_x) / TILE_SIZE;
+    int last_column = std::min(info.columns - 1, (int)(right * to_level_x) / TILE_SIZE);
+    int first_row = (int)(top * to_level_y) / TILE_SIZE;
+    int last_row = std::min(info.rows - 1, (int)(bottom * to_level_y) / TILE_SIZE);
+
+    for (int row = first_row; row <= last_row; row++) {
+        for (int column = first_column; column <= last_column; column++) {
+            float tile_width = std::min(TILE_SIZE, info.width - column * TILE_SIZE);
+            float tile_height = std::min(TILE_SIZE, info.height - row * TILE_SIZE);
+            Rectangle region = {column * TILE_SIZE / to_level_x, row * TILE_SIZE / to_level_y, tile_width / to_level_x, tile_height / to_level_y};
+            auto slot = DeepZoom::tile(level, column, row, uploads);
+            if (slot != NULL && slot->rows == (int)tile_height) {
+                draw_part(*slot, {0, 0, tile_width, tile_height}, region);
+                continue;
+            }
+
+            for (int coarser = level + 1; coarser < (int)_levels.size(); coarser++) {
+                int shift = coarser - level;
+                auto& parent_info = _levels[coarser];
+                auto parent = DeepZoom::tile(coarser, column >> shift, row >> shift, uploads);
+                if (parent == NULL)
+                    continue;
+
+                float parent_x = region.x * parent_info.width / width - (column >> shift) * TILE_SIZE;
+                float parent_y = region.y * parent_info.height / height - (row >> shift) * TILE_SIZE;
+                float parent_width = region.width * parent_info.width / width;
+                float parent_height = fminf(region.height * parent_info.height / height, parent->rows - parent_y);
+                if (parent_height <= 0)
+                    continue;
+                draw_part(*parent, {parent_x, parent_y, parent_width, parent_height}, {region.x, region.y, region.width, parent_height * height / parent_info.height});
+                break;
+            }
+            if (slot != NULL)
+                draw_part(*slot, {0, 0, tile_width, (float)slot->rows}, {region.x, region.y, region.width, slot->rows / to_level_y});
+        }
+    }
+    // Tiles over the upload budget are drawn from a coarser level, the next frames bring them in.
+    _settled = uploads < TILE_UPLOADS_PER_FRAME;
+    DeepZoom::trim();
+    return true;
+}
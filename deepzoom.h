@@ -0,0 +1,110 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef DEEPZOOM_H
+#define DEEPZOOM_H
+
+#include <stddef.h>
+#include <time.h>
+#include <raylib.h>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "renderimage.h"
+
+const int TILE_SIZE = 256;
+const int TILE_MAX_LEVELS = 24;
+// Images with a side past TILED_MIN_SIZE (beyond what every GL driver takes) or more pixels than
+// TILED_MIN_PIXELS (a 256 MB texture) are drawn from tiles.
+const int TILED_MIN_SIZE = 8192;
+const long TILED_MIN_PIXELS = 64L * 1024 * 1024;
+// Tile textures kept on the GPU (about 75 MB of RGB), and how many may be uploaded per frame.
+const int TILE_CACHE_TILES = 384;
+const int TILE_UPLOADS_PER_FRAME = 8;
+
+/*
+ * TileLevel struct.
+ * One level of the pyramid: its size in pixels, its size in tiles and where its tiles start in the tile file.
+ * Level 0 is the image at full size, every further level is half the size of the one before it.
+ */
+struct TileLevel {
+    int width;
+    int height;
+    int columns;
+    int rows;
+    size_t offset;
+};
+
+/*
+ * TileSlot struct.
+ * A tile texture on the GPU, how many of its rows were written when it was uploaded (tiles are
+ * uploaded while the pyramid is still being built and updated as it grows) and when it was last drawn.
+ */
+struct TileSlot {
+    Texture2D texture;
+    int rows;
+    unsigned long frame;
+};
+
+/*
+ * DeepZoom struct.
+ * Draws images that are too large for a single texture. A worker streams the file once, row by row,
+ * and writes a pyramid of TILE_SIZE tiles into an unlinked temporary file, every level built from
+ * the rows of the one below it as they come in. The render loop draws only the tiles covering the window,
+ * from the level that matches the zoom, uploading at most TILE_UPLOADS_PER_FRAME of them per frame and
+ * drawing a coarser tile wherever a finer one is not there yet. The image fills in from the top while
+ * the pyramid is built, panning afterwards only reads tiles. Only the image in slide view is tiled.
+ */
+struct DeepZoom {
+public:
+    static bool wants(int width, int height);
+    static void update(RenderImage* entry);
+    static bool draw(RenderImage& entry, Rectangle rect, float rotation);
+    static void stop();
+
+    static bool active() { return _worker.joinable(); }
+    static bool failed() { return _failed; }
+    static bool tiling() { return _tiling; }
+    static bool settled() { return _settled; }
+    static size_t tiles() { return _tiles.size(); }
+    static size_t bytes();
+    static float progress();
+
+private:
+    static void start(RenderImage& entry);
+    static void worker(char* path);
+    static bool tile_jpeg(const unsigned char* data, size_t size);
+    static bool tile_png(const unsigned char* data, size_t size);
+    static bool layout(int width, int height, int channels);
+    static void push_row(int level, const unsigned char* row);
+    static unsigned char* tile_data(int level, int column, int row);
+    static int tile_rows(int level, int row);
+    static TileSlot* tile(int level, int column, int row, int& uploads);
+    static void trim();
+
+    static std::thread _worker;
+    static std::atomic<bool> _running;
+    static std::atomic<bool> _ready;
+    static std::atomic<bool> _failed;
+    static std::atomic<bool> _tiling;
+    static bool _settled;
+    static std::atomic<int> _rows[TILE_MAX_LEVELS];
+    static std::vector<TileLevel> _levels;
+    static std::vector<std::vector<unsigned char>> _pending;
+    static std::vector<std::vector<unsigned char>> _half;
+    static unsigned char* _map;
+    static size_t _map_size;
+    static int _channels;
+    static unsigned int _id;
+    static time_t _mtime;
+    static std::unordered_map<unsigned long long, TileSlot> _tiles;
+    static unsigned long _frame;
+};
+
+#endif // DEEPZOOM_H
@@ -0,0 +1,535 @@
+#include "dirscanner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <chrono>
+#include "ryi.h"
+#include "imageprobe.h"
+#include "uring.h"
+#include "dirwatcher.h"
+#include "catalogsort.h"
+#include "mappedfile.h"
+
+// Entries found by one thread are handed to the render loop in batches of this size.
+const size_t SCAN_BATCH = 256;
+// Bytes read from the start of every file on io_uring, enough for the header of nearly every image.
+const unsigned int SCAN_HEAD_SIZE = 4096;
+// Submission queue depth of every scanner thread's ring.
+const unsigned int SCAN_RING_ENTRIES = 256;
+// Files decoded by the legacy loop and read through the loader in `benchmark`.
+const size_t BENCH_FILES = 200;
+// Result of an operation the ring has not completed, no result or -errno has this value.
+const int PENDING = INT_MIN;
+
+std::vector<std::thread> DirScanner::_workers;
+std::deque<ScanQueue> DirScanner::_queues;
+std::deque<RenderImage> DirScanner::_found;
+std::mutex DirScanner::_mutex;
+std::atomic<int> DirScanner::_pending(0);
+std::atomic<int> DirScanner::_queued(0);
+std::mutex DirScanner::_wait_mutex;
+std::condition_variable DirScanner::_wait;
+std::atomic<bool> DirScanner::_running(false);
+std::atomic<size_t> DirScanner::_files(0);
+std::atomic<size_t> DirScanner::_directories(0);
+char* DirScanner::_root = NULL;
+bool DirScanner::_done = true;
+bool DirScanner::recursive = false;
+
+// raylib's TextFormat hands out shared static buffers, it is not safe on the scanner threads.
+static char* join_path(const char* dir, const char* name) {
+    size_t size = strlen(dir) + strlen(name) + 2;
+    char* path = (char*)malloc(size);
+    snprintf(path, size, "%s/%s", dir, name);
+    return path;
+}
+
+/*
+ * Waits for `count` operations of a window. When the kernel stops taking calls the operations still
+ * in flight are drained (their results are kept) and the ring is closed, the thread scans on with
+ * plain syscalls. Returns false when even the drain failed: operations may still be running then and
+ * the buffers they write into have to be `abandon`ed.
+ */
+static bool wait_ring(Uring& ring, unsigned int count, int* results) {
+    if (ring.wait_all(count, results))
+        return true;
+
+    TraceLog(LOG_WARNING, "RYI: io_uring failed (%s), scanning on with plain syscalls", strerror(errno));
+    bool drained = ring.drain(results);
+    ring.close();
+    return drained;
+}
+
+/*
+ * Leaves `buffer` to the operations of a ring that could not be drained and puts a copy in its place.
+ */
+template <typename T>
+static void abandon(std::vector<T>& buffer) {
+    auto leaked = new std::vector<T>();
+    leaked->swap(buffer);
+    buffer = *leaked;
+}
+
+void DirScanner::start(const char* path, int workers) {
+    DirScanner::stop();
+
+    // Scanning is mostly waiting on the file system (a NAS even more so), more threads than cores pay off.
+    if (workers <= 0) {
+        workers = (int)std::thread::hardware_concurrency();
+        if (workers < 4) workers = 4;
+    }
+
+    free(_root);
+    _root = strdup(path);
+    _files = 0;
+    _directories = 0;
+    _done = false;
+    _running = true;
+    for (int i = 0; i < workers; i++)
+        _queues.emplace_back();
+
+    _pending = 1;
+    _queued = 1;
+    _queues[0].dirs.push_back(strdup(path));
+    for (int i = 0; i < workers; i++)
+        _workers.emplace_back(DirScanner::worker, i);
+}
+
+void DirScanner::stop() {
+    _running = false;
+    DirScanner::notify(true);
+    for (auto& worker: _workers)
+        worker.join();
+    _workers.clear();
+
+    for (auto& queue: _queues) {
+        for (auto dir: queue.dirs)
+            free(dir);
+    }
+    _queues.clear();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& image: _found) {
+        free(image.path);
+        free(image.sort_key);
+    }
+    _found.clear();
+    _pending = 0;
+    _queued = 0;
+    _done = true;
+}
+
+/*
+ * Adds up to `max_entries` of the entries found so far to the catalog.
+ * Returns true once, on the call that adds the last entry of a finished scan.
+ */
+bool DirScanner::poll(int max_entries) {
+    if (_done)
+        return false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int i = 0; i < max_entries && !_found.empty(); i++) {
+        Ryi::add_image(_found.front());
+        _found.pop_front();
+    }
+
+    if (_pending == 0 && _found.empty()) {
+        _done = true;
+        return true;
+    }
+    return false;
+}
+
+bool DirScanner::scanning() {
+    return !_done;
+}
+
+const char* DirScanner::root() {
+    return _root;
+}
+
+size_t DirScanner::files() {
+    return _files;
+}
+
+size_t DirScanner::directories() {
+    return _directories;
+}
+
+/*
+ * Takes the newest directory of this thread's own queue, or steals the oldest one of another thread.
+ */
+bool DirScanner::next_dir(int index, char** path) {
+    {
+        auto& own = _queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.dirs.empty()) {
+            *path = own.dirs.back();
+            own.dirs.pop_back();
+            _queued--;
+            return true;
+        }
+    }
+
+    int count = (int)_queues.size();
+    for (int i = 1; i < count; i++) {
+        auto& victim = _queues[(index + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.dirs.empty()) {
+            *path = victim.dirs.front();
+            victim.dirs.pop_front();
+            _queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirScanner::push_dir(int index, char* path) {
+    {
+        auto& own = _queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        _pending++;
+        _queued++;
+        own.dirs.push_back(path);
+    }
+    DirScanner::notify(false);
+}
+
+/*
+ * Wakes one thread waiting for a directory, or all of them when the walk is over. Taking the lock
+ * first means a thread that just found nothing is either waiting already or sees the new count.
+ */
+void DirScanner::notify(bool all) {
+    {
+        std::lock_guard<std::mutex> lock(_wait_mutex);
+    }
+    if (all)
+        _wait.notify_all();
+    else
+        _wait.notify_one();
+}
+
+/*
+ * `_pending` counts the directories that are queued or being read. A directory is only counted
+ * down after its subdirectories were queued, so zero means the whole tree has been walked.
+ * Threads without a directory to take sleep until one is queued (`_queued`) or the walk is over,
+ * the others may sit in readdir on a slow mount for a long time.
+ */
+void DirScanner::worker(int index) {
+    Uring ring;
+    if (Uring::enabled && !ring.init(SCAN_RING_ENTRIES) && index == 0)
+        TraceLog(LOG_WARNING, "RYI: io_uring is not available, scanning with plain syscalls");
+
+    std::vector<RenderImage> batch;
+    while (_running && _pending > 0) {
+        char* path;
+        if (!DirScanner::next_dir(index, &path)) {
+            std::unique_lock<std::mutex> lock(_wait_mutex);
+            _wait.wait(lock, []() { return !_running || _pending == 0 || _queued > 0; });
+            continue;
+        }
+
+        DirScanner::scan_dir(index, path, ring, batch);
+        free(path);
+        DirScanner::flush(batch);
+        if (--_pending == 0)
+            DirScanner::notify(true);
+    }
+}
+
+void DirScanner::flush(std::vector<RenderImage>& batch) {
+    if (batch.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _found.insert(_found.end(), batch.begin(), batch.end());
+    batch.clear();
+}
+
+void DirScanner::scan_dir(int index, const char* path, Uring& ring, std::vector<RenderImage>& batch) {
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0)
+        return;
+    DIR* dir = fdopendir(dir_fd);
+    if (dir == NULL) {
+        close(dir_fd);
+        return;
+    }
+    _directories++;
+    DirWatcher::watch(path);
+
+    std::vector<char*> unknown;
+    std::vector<char*> images;
+    dirent* next_dir = readdir(dir);
+    while (next_dir != NULL && _running) {
+        char* file_name = next_dir->d_name;
+        // Some file systems (XFS without ftype, many network mounts) leave d_type empty.
+        if (next_dir->d_type == DT_UNKNOWN)
+            unknown.push_back(strdup(file_name));
+        else
+            DirScanner::classify(index, path, file_name, next_dir->d_type, images);
+
+        if (unknown.size() >= SCAN_BATCH)
+            DirScanner::resolve(index, dir_fd, path, ring, unknown, images);
+        if (images.size() >= SCAN_BATCH)
+            DirScanner::ingest(dir_fd, path, ring, images, batch);
+        next_dir = readdir(dir);
+    }
+    DirScanner::resolve(index, dir_fd, path, ring, unknown, images);
+    DirScanner::ingest(dir_fd, path, ring, images, batch);
+    closedir(dir);
+}
+
+/*
+ * Queues subdirectories and collects the names of the files among the entries of `path`. Every regular
+ * file is a candidate, `ingest` tells images from the rest by their first bytes.
+ */
+void DirScanner::classify(int index, const char* path, const char* file_name, int type, std::vector<char*>& images) {
+    // Hidden directories are skipped, they tend to be caches (thumbnails included) and VCS data.
+    if (type == DT_DIR && DirScanner::recursive && file_name[0] != '.') {
+        DirScanner::push_dir(index, join_path(path, file_name));
+        return;
+    }
+
+    if (type == DT_REG)
+        images.push_back(strdup(file_name));
+}
+
+/*
+ * Finds out the type of entries readdir did not report one for, with one statx each.
+ * On io_uring they are submitted as a batch, what the ring did not complete is done with plain statx.
+ */
+void DirScanner::resolve(int index, int dir_fd, const char* path, Uring& ring, std::vector<char*>& names, std::vector<char*>& images) {
+    const int flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+    std::vector<struct statx> stats(names.size());
+    std::vector<int> results(names.size(), PENDING);
+
+    size_t window = ring.ready() ? ring.capacity() : names.size();
+    for (size_t first = 0; first < names.size(); first += window) {
+        size_t count = names.size() - first < window ? names.size() - first : window;
+        unsigned int queued = 0;
+        for (size_t i = 0; ring.ready() && i < count; i++)
+            queued += ring.statx(dir_fd, names[first + i], flags, STATX_TYPE, &stats[first + i], i);
+        if (queued > 0 && !wait_ring(ring, queued, results.data() + first))
+            abandon(stats);
+
+        for (size_t i = first; i < first + count; i++) {
+            if (results[i] == PENDING)
+                results[i] = statx(dir_fd, names[i], flags, STATX_TYPE, &stats[i]);
+        }
+    }
+
+    for (size_t i = 0; i < names.size(); i++) {
+        if (results[i] == 0) {
+            int type = S_ISDIR(stats[i].stx_mode) ? DT_DIR : S_ISREG(stats[i].stx_mode) ? DT_REG : DT_UNKNOWN;
+            DirScanner::classify(index, path, names[i], type, images);
+        }
+        free(names[i]);
+    }
+    names.clear();
+}
+
+/*
+ * Opens, stats and probes the files in `names` and adds catalog entries for the ones that are images.
+ * On io_uring this is three batched rounds (openat, statx + a read of the file head, close) for
+ * a whole window of files, instead of an open, fstat, a few preads and a close per file. Operations
+ * the ring could not take or did not complete are redone with plain syscalls.
+ */
+void DirScanner::ingest(int dir_fd, const char* path, Uring& ring, std::vector<char*>& names, std::vector<RenderImage>& batch) {
+    if (!ring.ready()) {
+        for (auto name: names) {
+            int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (fd >= 0 && fstat(fd, &st) == 0) {
+                // Header only probe, the grid needs the shape of every cell before any pixels exist.
+                ImageInfo info;
+                ProbeSource source = {.fd = fd, .head = NULL, .head_size = 0};
+                auto format = ImageProbe::identify(source, Ryi::file_format(strrchr(name, '.')), info);
+                if (format != FileFormat::UNKNOWN)
+                    DirScanner::found(path, name, st.st_size, st.st_mtime, format, info, batch);
+            }
+            if (fd >= 0)
+                close(fd);
+            free(name);
+        }
+        names.clear();
+        return;
+    }
+
+    static thread_local std::vector<unsigned char> heads;
+    size_t window = ring.capacity() / 2;
+    heads.resize(window * SCAN_HEAD_SIZE);
+    std::vector<int> fds(window);
+    std::vector<int> results(window * 2);
+    std::vector<struct statx> stats(window);
+
+    for (size_t first = 0; first < names.size(); first += window) {
+        size_t count = names.size() - first < window ? names.size() - first : window;
+        unsigned int queued = 0;
+        for (size_t i = 0; i < count; i++) {
+            fds[i] = PENDING;
+            if (ring.ready())
+                queued += ring.openat(dir_fd, names[first + i], O_RDONLY | O_CLOEXEC, i);
+        }
+        if (queued > 0)
+            wait_ring(ring, queued, fds.data());
+        for (size_t i = 0; i < count; i++) {
+            if (fds[i] == PENDING)
+                fds[i] = openat(dir_fd, names[first + i], O_RDONLY | O_CLOEXEC);
+        }
+
+        queued = 0;
+        for (size_t i = 0; i < count; i++) {
+            results[i * 2] = results[i * 2 + 1] = PENDING;
+            if (fds[i] < 0 || !ring.ready())
+                continue;
+            queued += ring.statx(fds[i], "", AT_EMPTY_PATH, STATX_SIZE | STATX_MTIME, &stats[i], i * 2);
+            queued += ring.read(fds[i], &heads[i * SCAN_HEAD_SIZE], SCAN_HEAD_SIZE, 0, i * 2 + 1);
+        }
+        if (queued > 0 && !wait_ring(ring, queued, results.data())) {
+            abandon(stats);
+            abandon(heads);
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (fds[i] < 0)
+                continue;
+            if (results[i * 2] == PENDING)
+                results[i * 2] = statx(fds[i], "", AT_EMPTY_PATH, STATX_SIZE | STATX_MTIME, &stats[i]);
+            if (results[i * 2 + 1] == PENDING)
+                results[i * 2 + 1] = pread(fds[i], &heads[i * SCAN_HEAD_SIZE], SCAN_HEAD_SIZE, 0);
+        }
+
+        queued = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (fds[i] < 0)
+                continue;
+            if (results[i * 2] == 0) {
+                const char* name = names[first + i];
+                // Headers past the bytes read already (a JPEG behind a big EXIF block) fall back to preads.
+                ProbeSource source = {
+                    .fd = fds[i],
+                    .head = &heads[i * SCAN_HEAD_SIZE],
+                    .head_size = results[i * 2 + 1] > 0 ? (size_t)results[i * 2 + 1] : 0,
+                };
+                ImageInfo info;
+                auto format = ImageProbe::identify(source, Ryi::file_format(strrchr(name, '.')), info);
+                if (format != FileFormat::UNKNOWN)
+                    DirScanner::found(path, name, stats[i].stx_size, stats[i].stx_mtime.tv_sec, format, info, batch);
+            }
+            if (ring.ready() && ring.close_fd(fds[i], i))
+                queued++;
+            else
+                close(fds[i]);
+        }
+        // A close the ring did not complete is not redone, the descriptor may already belong to another file.
+        if (queued > 0)
+            wait_ring(ring, queued, results.data());
+    }
+
+    for (auto name: names)
+        free(name);
+    names.clear();
+}
+
+void DirScanner::found(const char* path, const char* name, long size, time_t mtime, FileFormat format, ImageInfo& info, std::vector<RenderImage>& batch) {
+    batch.push_back((RenderImage){
+        .path = join_path(path, name),
+        .file_size = size,
+        .mtime = mtime,
+        .format = format,
+        .width = info.width,
+        .height = info.height,
+        .channels = info.channels,
+        .bit_depth = info.bit_depth,
+        .capture_time = info.capture_time,
+    });
+    // The sort key is built here, on the scanner threads, so the render loop only ever sorts.
+    batch.back().sort_key = CatalogSort::natural_key(batch.back().path);
+    _files++;
+    if (batch.size() >= SCAN_BATCH)
+        DirScanner::flush(batch);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static double bench_scan(const char* path, bool uring) {
+    Uring::enabled = uring;
+    auto start = std::chrono::steady_clock::now();
+    DirScanner::start(path);
+    while (!DirScanner::poll(1 << 20))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return seconds_since(start);
+}
+
+static double bench_read(std::vector<char*>& paths, bool uring) {
+    Uring::enabled = uring;
+    auto start = std::chrono::steady_clock::now();
+    volatile unsigned char sum = 0;
+    for (auto path: paths) {
+        MappedFile file;
+        if (!file.open(path))
+            continue;
+        for (size_t offset = 0; offset < file.size(); offset += 4096)
+            sum += file.data()[offset];
+        file.close();
+    }
+    return seconds_since(start);
+}
+
+/*
+ * `ryi -b <dir>`: times ingesting `path` the way ryi used to (readdir plus a full decode of every file,
+ * capped at BENCH_FILES), with the scanner on plain syscalls and on io_uring, and reading files
+ * through the loader's mmap and io_uring paths. Nothing drops the page cache in between, run
+ * `echo 3 > /proc/sys/vm/drop_caches` before each run for cold numbers.
+ */
+void DirScanner::benchmark(const char* path) {
+    auto start = std::chrono::steady_clock::now();
+    size_t decoded = 0;
+    DIR* dir = opendir(path);
+    dirent* next_dir = dir != NULL ? readdir(dir) : NULL;
+    while (next_dir != NULL && decoded < BENCH_FILES) {
+        char* extension = strrchr(next_dir->d_name, '.');
+        if (next_dir->d_type == DT_REG && Ryi::is_image_supported(extension)) {
+            char* file = join_path(path, next_dir->d_name);
+            UnloadImage(LoadImage(file));
+            free(file);
+            decoded++;
+        }
+        next_dir = readdir(dir);
+    }
+    if (dir != NULL)
+        closedir(dir);
+    double legacy = seconds_since(start);
+    printf("readdir + decode:  %8zu files %8.3f s %10.0f files/s\n", decoded, legacy, decoded / legacy);
+
+    bool uring = Uring::enabled;
+    double plain = bench_scan(path, false);
+    printf("scan (syscalls):   %8zu files %8.3f s %10.0f files/s\n", DirScanner::files(), plain, DirScanner::files() / plain);
+    Ryi::unload_images();
+    double batched = bench_scan(path, true);
+    printf("scan (io_uring):   %8zu files %8.3f s %10.0f files/s\n", DirScanner::files(), batched, DirScanner::files() / batched);
+
+    std::vector<char*> paths;
+    for (auto& image: Ryi::images()) {
+        if (paths.size() >= BENCH_FILES)
+            break;
+        paths.push_back(image.path);
+    }
+    double mapped = bench_read(paths, false);
+    printf("read (mmap):       %8zu files %8.3f s %10.0f files/s\n", paths.size(), mapped, paths.size() / mapped);
+    double read = bench_read(paths, true);
+    printf("read (io_uring):   %8zu files %8.3f s %10.0f files/s\n", paths.size(), read, paths.size() / read);
+
+    Ryi::unload_images();
+    Uring::enabled = uring;
+}
@@ -0,0 +1,81 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef DIRSCANNER_H
+#define DIRSCANNER_H
+
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+#include "renderimage.h"
+#include "imageprobe.h"
+
+struct Uring;
+
+/*
+ * ScanQueue struct.
+ * The directories one scanner thread still has to read. The owner works off the back (depth first,
+ * the paths are still warm in the dentry cache), idle threads steal from the front, which holds
+ * the directories closest to the root and so the biggest chunks of work.
+ */
+struct ScanQueue {
+    std::mutex mutex;
+    std::deque<char*> dirs;
+};
+
+/*
+ * DirScanner struct.
+ * Walks a directory (and with `recursive` the whole tree below it) on a pool of work stealing threads.
+ * Catalog entries are handed over in batches while the walk is still going, the render loop adds them
+ * through `poll`, so the first images show up long before a big tree is done.
+ */
+struct DirScanner {
+public:
+    static void start(const char* path, int workers = 0);
+    static void stop();
+    static bool poll(int max_entries);
+    static bool scanning();
+    static const char* root();
+    static size_t files();
+    static size_t directories();
+    static void benchmark(const char* path);
+
+    static bool recursive;
+
+private:
+    static void worker(int index);
+    static bool next_dir(int index, char** path);
+    static void push_dir(int index, char* path);
+    static void scan_dir(int index, const char* path, Uring& ring, std::vector<RenderImage>& batch);
+    static void classify(int index, const char* path, const char* file_name, int type, std::vector<char*>& images);
+    static void resolve(int index, int dir_fd, const char* path, Uring& ring, std::vector<char*>& names, std::vector<char*>& images);
+    static void ingest(int dir_fd, const char* path, Uring& ring, std::vector<char*>& names, std::vector<RenderImage>& batch);
+    static void found(const char* path, const char* name, long size, time_t mtime, FileFormat format, ImageInfo& info, std::vector<RenderImage>& batch);
+    static void flush(std::vector<RenderImage>& batch);
+    static void notify(bool all);
+
+    static std::vector<std::thread> _workers;
+    static std::deque<ScanQueue> _queues;
+    static std::deque<RenderImage> _found;
+    static std::mutex _mutex;
+    static std::atomic<int> _pending;
+    static std::atomic<int> _queued;
+    static std::mutex _wait_mutex;
+    static std::condition_variable _wait;
+    static std::atomic<bool> _running;
+    static std::atomic<size_t> _files;
+    static std::atomic<size_t> _directories;
+    static char* _root;
+    static bool _done;
+};
+
+#endif // DIRSCANNER_H
@@ -0,0 +1,288 @@
+#include "dirwatcher.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "ryi.h"
+#include "imageloader.h"
+#include "imageprobe.h"
+#include "dirscanner.h"
+#include "mappedfile.h"
+#include "idle.h"
+
+// Events are read until the queue is empty or this many were applied, the rest wait for the next frame.
+const int WATCH_EVENTS_PER_FRAME = 1024;
+const uint32_t WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_DELETE_SELF | IN_ONLYDIR;
+
+int DirWatcher::_fd = -1;
+int DirWatcher::_stop_fd = -1;
+std::thread DirWatcher::_waker;
+std::condition_variable DirWatcher::_cond;
+bool DirWatcher::_woken = false;
+std::mutex DirWatcher::_mutex;
+std::unordered_map<int, char*> DirWatcher::_dirs;
+
+bool DirWatcher::start(const char* path) {
+    DirWatcher::stop();
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0) {
+        TraceLog(LOG_WARNING, "RYI: inotify is not available, `%s` will not be watched", path);
+        return false;
+    }
+    DirWatcher::watch(path);
+    _stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (_stop_fd >= 0)
+        _waker = std::thread(DirWatcher::waker, _fd, _stop_fd);
+    return true;
+}
+
+void DirWatcher::stop() {
+    // The waker polls the descriptor, it has to be gone before the descriptor is closed.
+    if (_waker.joinable()) {
+        uint64_t one = 1;
+        if (write(_stop_fd, &one, sizeof(one)) != sizeof(one))
+            TraceLog(LOG_WARNING, "RYI: Could not stop the directory watcher thread");
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _woken = false;
+        }
+        _cond.notify_all();
+        _waker.join();
+    }
+    if (_stop_fd >= 0)
+        close(_stop_fd);
+    _stop_fd = -1;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd >= 0)
+        close(_fd);
+    _fd = -1;
+    MappedFile::clear_writing();
+    for (auto& dir: _dirs)
+        free(dir.second);
+    _dirs.clear();
+}
+
+/*
+ * Adds a directory to the watch set. Called from the scanner threads as they walk a tree.
+ */
+void DirWatcher::watch(const char* path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_fd < 0)
+        return;
+
+    int wd = inotify_add_watch(_fd, path, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC)
+            TraceLog(LOG_WARNING, "RYI: Out of inotify watches (fs.inotify.max_user_watches), `%s` is not watched", path);
+        return;
+    }
+
+    // Watching the same directory twice hands out the same descriptor.
+    auto dir = _dirs.find(wd);
+    if (dir != _dirs.end())
+        free(dir->second);
+    _dirs[wd] = strdup(path);
+}
+
+/*
+ * Applies the pending events to the catalog. Returns the number of events applied.
+ */
+int DirWatcher::poll() {
+    if (_fd < 0)
+        return 0;
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    int applied = 0;
+    while (applied < WATCH_EVENTS_PER_FRAME) {
+        ssize_t size = read(_fd, buffer, sizeof(buffer));
+        if (size <= 0)
+            break;
+
+        for (char* next = buffer; next < buffer + size; ) {
+            auto event = (inotify_event*)next;
+            next += sizeof(inotify_event) + event->len;
+            applied++;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                TraceLog(LOG_WARNING, "RYI: Directory events were dropped, reopen the directory to catch up");
+                continue;
+            }
+
+            char* dir = NULL;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto watched = _dirs.find(event->wd);
+                if (watched != _dirs.end())
+                    dir = strdup(watched->second);
+                if (watched != _dirs.end() && (event->mask & IN_IGNORED)) {
+                    free(watched->second);
+                    _dirs.erase(watched);
+                }
+            }
+            if (dir == NULL)
+                continue;
+
+            if (event->len > 0) {
+                bool is_dir = event->mask & IN_ISDIR;
+                if (is_dir && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                    DirWatcher::dir_added(dir, event->name);
+                else if (is_dir && (event->mask & (IN_DELETE | IN_MOVED_FROM)))
+                    DirWatcher::dir_removed(dir, event->name);
+                // IN_CREATE and IN_MODIFY are a file that is still being written, it is picked up at
+                // IN_CLOSE_WRITE and read instead of mapped until then.
+                else if (!is_dir && (event->mask & IN_MODIFY))
+                    MappedFile::set_writing(TextFormat("%s/%s", dir, event->name), true);
+                else if (!is_dir && (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+                    MappedFile::set_writing(TextFormat("%s/%s", dir, event->name), false);
+                    DirWatcher::file_changed(dir, event->name);
+                } else if (!is_dir && (event->mask & (IN_DELETE | IN_MOVED_FROM))) {
+                    MappedFile::set_writing(TextFormat("%s/%s", dir, event->name), false);
+                    DirWatcher::file_removed(dir, event->name);
+                }
+            }
+            free(dir);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _woken = false;
+    }
+    _cond.notify_all();
+    return applied;
+}
+
+/*
+ * Sleeps until the inotify descriptor has events (or `stop_fd` is written) and wakes the render loop.
+ * The events stay in the queue for `poll`, the thread waits until it ran before polling again, the
+ * descriptor would be ready the whole time otherwise.
+ */
+void DirWatcher::waker(int fd, int stop_fd) {
+    pollfd fds[2] = {{.fd = fd, .events = POLLIN, .revents = 0}, {.fd = stop_fd, .events = POLLIN, .revents = 0}};
+    while (true) {
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _woken = true;
+        Idle::wake();
+        _cond.wait(lock, [stop_fd]() {
+            pollfd stop = {.fd = stop_fd, .events = POLLIN, .revents = 0};
+            return !_woken || ::poll(&stop, 1, 0) > 0;
+        });
+    }
+}
+
+/*
+ * A file was written or moved in. New files get an entry, known files get their metadata refreshed
+ * and their textures dropped, so whatever is on screen decodes the new content on the next request.
+ */
+void DirWatcher::file_changed(const char* dir, const char* name) {
+    const char* path = TextFormat("%s/%s", dir, name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    ImageInfo info;
+    ProbeSource source = {.fd = fd, .head = NULL, .head_size = 0};
+    auto format = ImageProbe::identify(source, Ryi::file_format(strrchr((char*)name, '.')), info);
+    close(fd);
+    if (format == FileFormat::UNKNOWN)
+        return;
+
+    auto entry = Ryi::find_image(path);
+    if (entry != NULL) {
+        if (entry->mtime == st.st_mtime && entry->file_size == (long)st.st_size)
+            return;
+
+        // Queued jobs are withdrawn, those already decoding carry the old version and are dropped at upload.
+        ImageLoader::withdraw(entry->id, TextureKind::FULL);
+        ImageLoader::withdraw(entry->id, TextureKind::THUMBNAIL);
+        entry->unload();
+        entry->version++;
+        entry->file_size = (long)st.st_size;
+        entry->mtime = st.st_mtime;
+        entry->format = format;
+        entry->width = info.width;
+        entry->height = info.height;
+        entry->channels = info.channels;
+        entry->bit_depth = info.bit_depth;
+        entry->capture_time = info.capture_time;
+    } else {
+        Ryi::add_image((RenderImage){
+            .path = strdup(path),
+            .file_size = (long)st.st_size,
+            .mtime = st.st_mtime,
+            .format = format,
+            .width = info.width,
+            .height = info.height,
+            .channels = info.channels,
+            .bit_depth = info.bit_depth,
+            .capture_time = info.capture_time,
+        });
+        entry = &Ryi::images().back();
+    }
+
+    if (Ryi::follow_newest)
+        Ryi::image_index = Ryi::image_slot(entry->id);
+}
+
+void DirWatcher::file_removed(const char* dir, const char* name) {
+    auto entry = Ryi::find_image(TextFormat("%s/%s", dir, name));
+    if (entry != NULL)
+        Ryi::remove_image(entry->id);
+}
+
+/*
+ * A directory was created or moved in below a watched one. Only followed with `-r`, its images are
+ * added right away (one level, deeper trees that are moved in as a whole need a reload).
+ */
+void DirWatcher::dir_added(const char* dir, const char* name) {
+    if (!DirScanner::recursive || name[0] == '.')
+        return;
+
+    char* path = strdup(TextFormat("%s/%s", dir, name));
+    DirWatcher::watch(path);
+    DIR* added = opendir(path);
+    dirent* next_dir = added != NULL ? readdir(added) : NULL;
+    while (next_dir != NULL) {
+        if (next_dir->d_type == DT_REG || next_dir->d_type == DT_UNKNOWN)
+            DirWatcher::file_changed(path, next_dir->d_name);
+        next_dir = readdir(added);
+    }
+    if (added != NULL)
+        closedir(added);
+    free(path);
+}
+
+/*
+ * A directory below a watched one went away, everything under it goes with it.
+ */
+void DirWatcher::dir_removed(const char* dir, const char* name) {
+    const char* prefix = TextFormat("%s/%s/", dir, name);
+    size_t length = strlen(prefix);
+    std::vector<unsigned int> removed;
+    for (auto& image: Ryi::images()) {
+        if (strncmp(image.path, prefix, length) == 0)
+            removed.push_back(image.id);
+    }
+    for (auto id: removed)
+        Ryi::remove_image(id);
+}
@@ -0,0 +1,49 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef DIRWATCHER_H
+#define DIRWATCHER_H
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+
+/*
+ * DirWatcher struct.
+ * Keeps the catalog in sync with the directory it was loaded from through inotify. Files that are
+ * written, deleted or moved change only their own entry (and drop only their own textures) instead
+ * of a full reload. The scanner registers every directory it reads, so `-r` trees are watched whole.
+ * `poll` runs on the render loop and applies whatever happened since the last frame. A thread blocks on
+ * the inotify descriptor and wakes the render loop from its idle sleep when events arrive, then waits
+ * for `poll` to read them. Files that are being written are read instead of mapped until they are closed.
+ */
+struct DirWatcher {
+public:
+    static bool start(const char* path);
+    static void stop();
+    static void watch(const char* path);
+    static int poll();
+
+private:
+    static void file_changed(const char* dir, const char* name);
+    static void file_removed(const char* dir, const char* name);
+    static void dir_added(const char* dir, const char* name);
+    static void dir_removed(const char* dir, const char* name);
+    static void waker(int fd, int stop_fd);
+
+    static int _fd;
+    static int _stop_fd;
+    static std::thread _waker;
+    static std::condition_variable _cond;
+    static bool _woken;
+    static std::mutex _mutex;
+    static std::unordered_map<int, char*> _dirs;
+};
+
+#endif // DIRWATCHER_H
@@ -43,6 +43,10 @@ public:
         this->message = message;
     }
 
+    bool visible() {
+        return this->message != nullptr;
+    }
+
 private:
     float duration = 3.0f;
     float alpha = 1.0f;
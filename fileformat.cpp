@@ -0,0 +1,101 @@
+#include "fileformat.h"
+#include <string.h>
+
+struct ExtensionSlot {
+    const char* name;
+    FileFormat format;
+};
+
+const size_t EXTENSION_SLOTS = 8;
+const size_t EXTENSION_MAX = 4;
+
+constexpr ExtensionSlot EXTENSIONS[] = {
+    {"png", FileFormat::PNG},
+    {"jpg", FileFormat::JPEG},
+    {"jpeg", FileFormat::JPEG},
+    {"jpe", FileFormat::JPEG},
+    {"jfif", FileFormat::JPEG},
+    {"bmp", FileFormat::BMP},
+    {"dib", FileFormat::BMP},
+    {"gif", FileFormat::GIF},
+};
+
+constexpr size_t extension_length(const char* name) {
+    return *name ? 1 + extension_length(name + 1) : 0;
+}
+
+constexpr size_t extension_hash(const char* name, size_t length) {
+    return (name[0] * 2 + name[length - 1] * 3 + length) & (EXTENSION_SLOTS - 1);
+}
+
+struct ExtensionTable {
+    ExtensionSlot slots[EXTENSION_SLOTS];
+};
+
+constexpr ExtensionTable extension_table() {
+    ExtensionTable table = {};
+    for (auto& extension: EXTENSIONS)
+        table.slots[extension_hash(extension.name, extension_length(extension.name))] = extension;
+    return table;
+}
+
+constexpr bool extension_hash_is_perfect() {
+    bool used[EXTENSION_SLOTS] = {};
+    for (auto& extension: EXTENSIONS) {
+        size_t slot = extension_hash(extension.name, extension_length(extension.name));
+        if (used[slot] || extension_length(extension.name) > EXTENSION_MAX)
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+static_assert(extension_hash_is_perfect(), "extension hash collides, pick new multipliers in extension_hash");
+constexpr ExtensionTable EXTENSION_TABLE = extension_table();
+
+/*
+ * `extension` is what follows the last dot of a file name (with or without the dot), in any case.
+ */
+FileFormat FileFormats::from_extension(const char* extension) {
+    if (extension == NULL) return FileFormat::UNKNOWN;
+    if (*extension == '.') extension++;
+
+    char lower[EXTENSION_MAX + 1];
+    size_t length = 0;
+    for (; extension[length] != '\0'; length++) {
+        if (length == EXTENSION_MAX) return FileFormat::UNKNOWN;
+        char c = extension[length];
+        lower[length] = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+    if (length == 0) return FileFormat::UNKNOWN;
+    lower[length] = '\0';
+
+    auto& slot = EXTENSION_TABLE.slots[extension_hash(lower, length)];
+    if (slot.name == NULL || strcmp(slot.name, lower) != 0)
+        return FileFormat::UNKNOWN;
+    return slot.format;
+}
+
+/*
+ * Needs the first MAGIC_SIZE bytes of the file, fewer only tell formats with shorter signatures apart.
+ */
+FileFormat FileFormats::from_magic(const unsigned char* data, size_t size) {
+    if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) return FileFormat::PNG;
+    if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) return FileFormat::JPEG;
+    if (size >= 6 && (memcmp(data, "GIF87a", 6) == 0 || memcmp(data, "GIF89a", 6) == 0)) return FileFormat::GIF;
+    if (size >= 2 && data[0] == 'B' && data[1] == 'M') return FileFormat::BMP;
+    return FileFormat::UNKNOWN;
+}
+
+/*
+ * The extension raylib's LoadImageFromMemory expects for a format.
+ */
+const char* FileFormats::extension(FileFormat format) {
+    switch (format) {
+    case FileFormat::PNG: return ".png";
+    case FileFormat::JPEG: return ".jpg";
+    case FileFormat::BMP: return ".bmp";
+    case FileFormat::GIF: return ".gif";
+    default: return NULL;
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef FILEFORMAT_H
+#define FILEFORMAT_H
+
+#include <stddef.h>
+
+enum class FileFormat {
+    UNKNOWN = 0,
+    PNG,
+    JPEG,
+    BMP,
+    GIF,
+};
+
+/*
+ * FileFormats struct.
+ * Tells image formats apart. `from_extension` is the cheap guess made from a file name, a minimal perfect
+ * hash over the known extensions (the first and last letter plus the length pick the slot, a single
+ * compare confirms it). `from_magic` is the answer, made from the first bytes of the file, and it is
+ * what picks the decoder, so misnamed files decode and non-images never reach one.
+ */
+struct FileFormats {
+public:
+    static const size_t MAGIC_SIZE = 8;
+
+    static FileFormat from_extension(const char* extension);
+    static FileFormat from_magic(const unsigned char* data, size_t size);
+    static const char* extension(FileFormat format);
+};
+
+#endif // FILEFORMAT_H
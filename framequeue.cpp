@@ -0,0 +1,25 @@
+#include "framequeue.h"
+#include <chrono>
+
+std::deque<FrameTask> FrameQueue::_tasks;
+double FrameQueue::_spent = 0;
+
+void FrameQueue::push(FrameTask task) {
+    _tasks.push_back(std::move(task));
+}
+
+void FrameQueue::drain(double budget) {
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    do {
+        if (_tasks.empty())
+            break;
+        // A task may push more tasks while it runs, those go to the back.
+        auto task = std::move(_tasks.front());
+        _tasks.pop_front();
+        if (!task())
+            _tasks.push_front(std::move(task));
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < budget);
+    _spent = elapsed.count();
+}
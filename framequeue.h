@@ -0,0 +1,45 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+
+// Main thread time per frame given to queued GL work, a quarter of a 60 fps frame.
+const double FRAME_BUDGET = 0.004;
+
+/*
+ * A step of main thread work. Returns true when the task is done, false when it has more steps
+ * (the next strip of an upload), it is called again when the budget allows.
+ */
+using FrameTask = std::function<bool()>;
+
+/*
+ * FrameQueue struct.
+ * The GL work raylib only allows on the main thread (uploads, texture frees) that does not have to
+ * happen in the frame it comes up in. The render loop drains it once per frame for at most FRAME_BUDGET,
+ * whatever is left waits for the next frame. Tasks run in order, a task with more steps keeps its
+ * place at the front until it is done. At least one step runs every frame, so the queue always moves.
+ * Only the main thread pushes and drains, there is no lock.
+ */
+struct FrameQueue {
+public:
+    static void push(FrameTask task);
+    static void drain(double budget);
+    static size_t pending() { return _tasks.size(); }
+    static double spent() { return _spent; }
+
+private:
+    static std::deque<FrameTask> _tasks;
+    static double _spent;
+};
+
+#endif // FRAMEQUEUE_H
@@ -0,0 +1,311 @@
+#include "gifdecoder.h"
+#include <string.h>
+
+// Frames without a delay (or 10 ms) play at 100 ms like they do in browsers, the value was meant as "fast".
+const float GIF_MIN_DELAY = 0.02f;
+const float GIF_DEFAULT_DELAY = 0.1f;
+const int GIF_MAX_CODES = 4096;
+// Logical screens beyond this are refused, the canvas alone would not fit into memory.
+const long GIF_MAX_PIXELS = 64L * 1024 * 1024;
+
+static int read_u16(const unsigned char* data) {
+    return data[0] | (data[1] << 8);
+}
+
+/*
+ * Reads the header, the logical screen and the global palette. Returns false for anything that is not a GIF.
+ */
+bool GifDecoder::open(const unsigned char* data, size_t size) {
+    if (size < 13 || (memcmp(data, "GIF87a", 6) != 0 && memcmp(data, "GIF89a", 6) != 0))
+        return false;
+
+    m_data = data;
+    m_size = size;
+    m_width = read_u16(data + 6);
+    m_height = read_u16(data + 8);
+    if (m_width <= 0 || m_height <= 0 || (long)m_width * m_height > GIF_MAX_PIXELS)
+        return false;
+
+    int flags = data[10];
+    m_offset = 13;
+    m_colors = 0;
+    if (flags & 0x80) {
+        m_colors = 2 << (flags & 7);
+        if (m_offset + m_colors * 3 > size)
+            return false;
+        memcpy(m_palette, data + m_offset, m_colors * 3);
+        m_offset += m_colors * 3;
+    }
+    m_first = m_offset;
+    GifDecoder::rewind();
+    return true;
+}
+
+/*
+ * Starts over at the first frame, with a cleared canvas.
+ */
+void GifDecoder::rewind() {
+    m_offset = m_first;
+    m_frame = 0;
+    m_disposal = 0;
+    m_transparent = -1;
+    m_delay = 0;
+    m_last_disposal = 0;
+    m_canvas.assign((size_t)m_width * m_height * 4, 0);
+}
+
+/*
+ * The canvas with the frame that was decoded last. Borrowed, the next call to `next` draws over it.
+ */
+Image GifDecoder::canvas() {
+    return (Image){
+        .data = m_canvas.data(),
+        .width = m_width,
+        .height = m_height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+}
+
+/*
+ * Decodes the next frame onto the canvas. `delay` receives how long it stays on screen in seconds.
+ * Returns false after the last frame, or when the rest of the file is broken.
+ */
+bool GifDecoder::next(float* delay) {
+    while (m_offset < m_size) {
+        int block = m_data[m_offset++];
+        if (block == 0x3B)
+            return false;
+
+        if (block == 0x21) {
+            if (m_offset >= m_size)
+                return false;
+            int label = m_data[m_offset++];
+            // Graphic control extension: disposal, delay and transparency of the next frame.
+            if (label == 0xF9 && m_offset + 6 <= m_size && m_data[m_offset] == 4) {
+                int flags = m_data[m_offset + 1];
+                m_disposal = (flags >> 2) & 7;
+                m_delay = read_u16(m_data + m_offset + 2) / 100.0f;
+                m_transparent = (flags & 1) ? m_data[m_offset + 4] : -1;
+            }
+            // Every extension is a chain of sub-blocks, whatever the label.
+            while (m_offset < m_size && m_data[m_offset] != 0)
+                m_offset += m_data[m_offset] + 1;
+            m_offset++;
+            continue;
+        }
+
+        if (block != 0x2C || !GifDecoder::read_frame())
+            return false;
+
+        *delay = m_delay < GIF_MIN_DELAY ? GIF_DEFAULT_DELAY : m_delay;
+        m_frame++;
+        m_disposal = 0;
+        m_transparent = -1;
+        m_delay = 0;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Reads an image descriptor and its pixels, after undoing the previous frame as its disposal method asks.
+ */
+bool GifDecoder::read_frame() {
+    if (m_offset + 9 > m_size)
+        return false;
+
+    int left = read_u16(m_data + m_offset);
+    int top = read_u16(m_data + m_offset + 2);
+    int width = read_u16(m_data + m_offset + 4);
+    int height = read_u16(m_data + m_offset + 6);
+    int flags = m_data[m_offset + 8];
+    m_offset += 9;
+
+    const unsigned char* palette = m_palette;
+    int colors = m_colors;
+    if (flags & 0x80) {
+        colors = 2 << (flags & 7);
+        if (m_offset + colors * 3 > m_size)
+            return false;
+        palette = m_data + m_offset;
+        m_offset += colors * 3;
+    }
+
+    GifDecoder::dispose();
+    if (m_disposal == 3)
+        m_previous = m_canvas;
+    m_last_left = left;
+    m_last_top = top;
+    m_last_width = width;
+    m_last_height = height;
+    m_last_disposal = m_disposal;
+    return GifDecoder::read_pixels(left, top, width, height, palette, colors, flags & 0x40);
+}
+
+/*
+ * Applies the disposal method of the frame drawn last: 2 clears its area (to transparent, like browsers do),
+ * 3 restores the canvas it was drawn on.
+ */
+void GifDecoder::dispose() {
+    if (m_last_disposal == 3 && m_previous.size() == m_canvas.size()) {
+        m_canvas.swap(m_previous);
+    } else if (m_last_disposal == 2) {
+        for (int y = m_last_top; y < m_last_top + m_last_height && y < m_height; y++) {
+            int right = m_last_left + m_last_width < m_width ? m_last_left + m_last_width : m_width;
+            if (m_last_left < right)
+                memset(&m_canvas[((size_t)y * m_width + m_last_left) * 4], 0, (size_t)(right - m_last_left) * 4);
+        }
+    }
+    m_last_disposal = 0;
+}
+
+/*
+ * Decodes the LZW stream of a frame and draws it onto the canvas as it goes. The code table lives on
+ * the stack, codes are pulled from the data sub-blocks one byte at a time. A stream that ends early
+ * leaves the rest of the frame as it was, like a partially loaded GIF in a browser.
+ */
+bool GifDecoder::read_pixels(int left, int top, int width, int height, const unsigned char* palette, int colors, bool interlaced) {
+    if (m_offset >= m_size)
+        return false;
+    int min_size = m_data[m_offset++];
+    if (min_size < 2 || min_size > 11)
+        return false;
+
+    unsigned short prefix[GIF_MAX_CODES];
+    unsigned char suffix[GIF_MAX_CODES];
+    unsigned char stack[GIF_MAX_CODES + 1];
+    int clear = 1 << min_size;
+    int end = clear + 1;
+    for (int code = 0; code < clear; code++) {
+        prefix[code] = 0;
+        suffix[code] = (unsigned char)code;
+    }
+
+    int code_size = min_size + 1;
+    int next = end + 1;
+    int old = -1;
+    int first = 0;
+    unsigned int bits = 0;
+    int bit_count = 0;
+    size_t block_end = m_offset;
+
+    // Interlaced frames store every 8th row first, then the 4th, 2nd and odd ones.
+    static const int PASS_START[4] = {0, 4, 2, 1};
+    static const int PASS_STEP[4] = {8, 8, 4, 2};
+    int pass = 0;
+    int x = 0;
+    int y = 0;
+    long remaining = (long)width * height;
+    bool ended = false;
+
+    while (!ended && remaining > 0) {
+        while (bit_count < code_size) {
+            if (m_offset == block_end) {
+                if (m_offset >= m_size || m_data[m_offset] == 0) {
+                    ended = true;
+                    break;
+                }
+                block_end = m_offset + 1 + m_data[m_offset];
+                m_offset++;
+                if (block_end > m_size)
+                    block_end = m_size;
+                continue;
+            }
+            bits |= (unsigned int)m_data[m_offset++] << bit_count;
+            bit_count += 8;
+        }
+        if (ended)
+            break;
+
+        int code = bits & ((1 << code_size) - 1);
+        bits >>= code_size;
+        bit_count -= code_size;
+
+        if (code == clear) {
+            code_size = min_size + 1;
+            next = end + 1;
+            old = -1;
+            continue;
+        }
+        if (code == end)
+            break;
+
+        int depth = 0;
+        if (old == -1) {
+            if (code >= clear)
+                break;
+            first = code;
+            stack[depth++] = (unsigned char)code;
+        } else {
+            int current = code;
+            if (code >= next) {
+                if (code > next)
+                    break;
+                stack[depth++] = (unsigned char)first;
+                current = old;
+            }
+            while (current >= clear && depth < GIF_MAX_CODES) {
+                stack[depth++] = suffix[current];
+                current = prefix[current];
+            }
+            first = suffix[current];
+            stack[depth++] = (unsigned char)first;
+
+            if (next < GIF_MAX_CODES) {
+                prefix[next] = (unsigned short)old;
+                suffix[next] = (unsigned char)first;
+                next++;
+                if (next == (1 << code_size) && code_size < 12)
+                    code_size++;
+            }
+        }
+        old = code;
+
+        while (depth > 0 && remaining > 0) {
+            int index = stack[--depth];
+            int canvas_x = left + x;
+            int canvas_y = top + y;
+            if (index != m_transparent && index < colors && canvas_x < m_width && canvas_y < m_height) {
+                unsigned char* pixel = &m_canvas[((size_t)canvas_y * m_width + canvas_x) * 4];
+                pixel[0] = palette[index * 3];
+                pixel[1] = palette[index * 3 + 1];
+                pixel[2] = palette[index * 3 + 2];
+                pixel[3] = 255;
+            }
+            remaining--;
+            if (++x < width)
+                continue;
+            x = 0;
+            if (!interlaced) {
+                y++;
+                continue;
+            }
+            y += PASS_STEP[pass];
+            while (y >= height && pass < 3) {
+                pass++;
+                y = PASS_START[pass];
+            }
+        }
+    }
+
+    // Skips whatever is left of the data sub-blocks, including the terminator.
+    m_offset = block_end;
+    while (m_offset < m_size && m_data[m_offset] != 0)
+        m_offset += m_data[m_offset] + 1;
+    m_offset++;
+    return true;
+}
+
+/*
+ * The first frame only, for thumbnails and for what is drawn until playback starts.
+ */
+Image GifDecoder::decode(const unsigned char* data, size_t size, int* width, int* height) {
+    GifDecoder decoder;
+    float delay;
+    if (!decoder.open(data, size) || !decoder.next(&delay))
+        return (Image){0};
+    *width = decoder.m_width;
+    *height = decoder.m_height;
+    return ImageCopy(decoder.canvas());
+}
@@ -0,0 +1,66 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef GIFDECODER_H
+#define GIFDECODER_H
+
+#include <stddef.h>
+#include <raylib.h>
+#include <vector>
+
+/*
+ * GifDecoder struct.
+ * Decodes a GIF one frame at a time, straight from the file's bytes. Every frame is composited onto a
+ * single RGBA canvas of the logical screen size (disposal methods and transparency applied), so memory
+ * stays at one or two canvases however many frames the file has, unlike raylib's LoadImageAnim, which
+ * decodes them all up front.
+ */
+struct GifDecoder {
+public:
+    bool open(const unsigned char* data, size_t size);
+    bool next(float* delay);
+    void rewind();
+
+    Image canvas();
+    int frame() { return m_frame; }
+
+    static Image decode(const unsigned char* data, size_t size, int* width, int* height);
+
+private:
+    bool read_frame();
+    bool read_pixels(int left, int top, int width, int height, const unsigned char* palette, int colors, bool interlaced);
+    void dispose();
+
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_offset = 0;
+    size_t m_first = 0;
+
+    int m_width = 0;
+    int m_height = 0;
+    unsigned char m_palette[256 * 3];
+    int m_colors = 0;
+    int m_frame = 0;
+
+    // Graphic control extension of the frame that is read next.
+    int m_disposal = 0;
+    int m_transparent = -1;
+    float m_delay = 0;
+
+    // Area and disposal method of the frame that was drawn last, applied before the next one is drawn.
+    int m_last_left = 0;
+    int m_last_top = 0;
+    int m_last_width = 0;
+    int m_last_height = 0;
+    int m_last_disposal = 0;
+
+    std::vector<unsigned char> m_canvas;
+    std::vector<unsigned char> m_previous;
+};
+
+#endif // GIFDECODER_H
@@ -0,0 +1,93 @@
+#include "idle.h"
+#include <raylib.h>
+
+// raylib links GLFW in without shipping its header, these are the two calls the sleep needs.
+extern "C" {
+void glfwWaitEventsTimeout(double timeout);
+void glfwPostEmptyEvent(void);
+}
+
+bool Idle::enabled = true;
+std::atomic<bool> Idle::_woken(false);
+std::atomic<bool> Idle::_waiting(false);
+int Idle::_frames = IDLE_SETTLE_FRAMES;
+size_t Idle::_drawn = 0;
+size_t Idle::_skipped = 0;
+double Idle::_idle_time = 0;
+
+/*
+ * Ends the render loop's sleep. Called from any thread, an empty event is only posted while the loop
+ * sleeps, otherwise the flag keeps it from starting one. Both sides go through sequentially consistent
+ * atomics, so either the loop sees the flag or the waker sees it waiting.
+ */
+void Idle::wake() {
+    _woken = true;
+    if (_waiting)
+        glfwPostEmptyEvent();
+}
+
+/*
+ * Draws at least `frames` more frames. Main thread only.
+ */
+void Idle::redraw(int frames) {
+    if (_frames < frames)
+        _frames = frames;
+}
+
+/*
+ * Called once per frame after the update logic. Returns true when the frame is to be drawn,
+ * otherwise sleeps until the next event (or the timeout) and returns false, the loop skips
+ * drawing and runs its update logic again.
+ */
+bool Idle::frame() {
+    if (!enabled || _frames > 0) {
+        if (_frames > 0)
+            _frames--;
+        _drawn++;
+        return true;
+    }
+
+    Idle::wait();
+    _skipped++;
+    return false;
+}
+
+/*
+ * EndDrawing polls input on a drawn frame, a skipped one has to do it itself. Polling first moves the
+ * current key and button states to the previous ones, the events the sleep dispatches then set the
+ * new ones, so IsKeyPressed still sees the press on the next update.
+ */
+void Idle::wait() {
+    PollInputEvents();
+    if (Idle::input()) {
+        Idle::redraw();
+        return;
+    }
+
+    double start = GetTime();
+    _waiting = true;
+    if (!_woken.exchange(false))
+        glfwWaitEventsTimeout(IDLE_TIMEOUT);
+    _waiting = false;
+    _woken = false;
+    double slept = GetTime() - start;
+    _idle_time += slept;
+    // Anything but the timeout ending the sleep is an event (or finished work) the screen has to show.
+    if (slept < IDLE_TIMEOUT)
+        Idle::redraw();
+}
+
+/*
+ * Whether the last poll saw input: a moved mouse or wheel, a button or key going down, a resize.
+ */
+bool Idle::input() {
+    Vector2 delta = GetMouseDelta();
+    if (delta.x != 0 || delta.y != 0 || GetMouseWheelMove() != 0 || IsWindowResized())
+        return true;
+    for (int button = MOUSE_BUTTON_LEFT; button <= MOUSE_BUTTON_BACK; button++) {
+        if (IsMouseButtonPressed(button) || IsMouseButtonReleased(button))
+            return true;
+    }
+    // Nothing else reads the queue of pressed keys, PollInputEvents empties it every frame.
+    return GetKeyPressed() != 0;
+}
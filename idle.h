@@ -0,0 +1,55 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Longest the render loop sleeps without an event. Work that changes the screen wakes it, this only bounds a missed wake.
+const double IDLE_TIMEOUT = 0.5;
+// Frames still drawn after the last event, so hover states and the last upload make it to the screen.
+const int IDLE_SETTLE_FRAMES = 2;
+// Frame time handed to per frame animation after a sleep, the sleep itself is not time that passed on screen.
+const float IDLE_MAX_FRAME_TIME = 1.0f / 30;
+
+/*
+ * Idle struct.
+ * Stops the render loop from redrawing frames that would look like the last one. The loop asks
+ * `redraw` for a few more frames whenever something moved (input, an animation, a load, a resize),
+ * once those are drawn `wait` sleeps in GLFW until the next event instead of drawing. Threads that
+ * finish work for the screen call `wake`, which posts an empty event to end the sleep early.
+ * raylib's EnableEventWaiting would sleep without a timeout and only polls input in EndDrawing,
+ * this keeps the update logic running on a skipped frame, where the DirWatcher applies what woke it.
+ * Optional, `-a` keeps redrawing every frame.
+ */
+struct Idle {
+public:
+    static void wake();
+    static void redraw(int frames = IDLE_SETTLE_FRAMES);
+    static bool frame();
+    static size_t drawn() { return _drawn; }
+    static size_t skipped() { return _skipped; }
+    static double idle_time() { return _idle_time; }
+
+    static bool enabled;
+
+private:
+    static void wait();
+    static bool input();
+
+    static std::atomic<bool> _woken;
+    static std::atomic<bool> _waiting;
+    static int _frames;
+    static size_t _drawn;
+    static size_t _skipped;
+    static double _idle_time;
+};
+
+#endif // IDLE_H
@@ -0,0 +1,962 @@
+#include "imageloader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include <curl/curl.h>
+#include <png.h>
+#include "ryi.h"
+#include "texturecache.h"
+#include "prefetcher.h"
+#include "thumbnailcache.h"
+#include "mappedfile.h"
+#include "jpegdecoder.h"
+#include "progressivedecoder.h"
+#include "gifdecoder.h"
+#include "texturecodec.h"
+#include "pixelbuffers.h"
+#include "framequeue.h"
+#include "uploadthread.h"
+#include "texturepool.h"
+#include "idle.h"
+
+std::vector<std::thread> ImageLoader::_workers;
+std::deque<DecodeJob> ImageLoader::_jobs;
+std::deque<DecodedImage> ImageLoader::_done;
+std::mutex ImageLoader::_mutex;
+std::condition_variable ImageLoader::_cond;
+unsigned int ImageLoader::_generation = 0;
+int ImageLoader::_in_flight = 0;
+bool ImageLoader::_running = false;
+size_t ImageLoader::_uploaded = 0;
+double ImageLoader::_upload_time[2] = {0};
+size_t ImageLoader::_uploads[2] = {0};
+bool ImageLoader::high_precision = false;
+
+void ImageLoader::start(int workers) {
+    if (_running) return;
+
+    if (workers <= 0) {
+        workers = (int)std::thread::hardware_concurrency() - 1;
+        if (workers < 1) workers = 1;
+    }
+
+    _running = true;
+    for (int i = 0; i < workers; i++)
+        _workers.emplace_back(ImageLoader::worker);
+}
+
+void ImageLoader::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_running) return;
+        _running = false;
+    }
+    _cond.notify_all();
+    for (auto& worker: _workers)
+        worker.join();
+    _workers.clear();
+    UploadThread::stop();
+
+    ImageLoader::cancel();
+    PixelBuffers::unload();
+}
+
+void ImageLoader::request(RenderImage& image, TextureKind kind, bool urgent, float width, float height) {
+    // A thumbnail pyramid is built from its largest level, that is the size the decode has to cover.
+    if (kind == TextureKind::THUMBNAIL) {
+        float size = THUMBNAIL_SIZES[THUMBNAIL_LEVELS - 1];
+        float scale = image.width > 0 && image.height > 0 ? size / (image.width > image.height ? image.width : image.height) : 0;
+        width = image.width * scale;
+        height = image.height * scale;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const char* source = image.source();
+        DecodeJob job = {
+            .id = image.id,
+            .kind = kind,
+            .path = strdup(source),
+            .url = NULL,
+            .mtime = source == image.path ? image.mtime : 0,
+            .version = image.version,
+            .target_width = (int)ceilf(width),
+            .target_height = (int)ceilf(height),
+            // Refinements keep drawing the texture they replace, passes would only make it blurrier.
+            .progressive = kind == TextureKind::FULL && image.state != TextureState::READY,
+        };
+        if (urgent)
+            _jobs.push_front(job);
+        else
+            _jobs.push_back(job);
+    }
+    _cond.notify_one();
+}
+
+/*
+ * Downloads `url` to the entry's source file on a worker and decodes it while it downloads,
+ * so the passes of a progressive file show up before the transfer is done.
+ */
+void ImageLoader::download(RenderImage& image, const char* url) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        DecodeJob job = {
+            .id = image.id,
+            .kind = TextureKind::FULL,
+            .path = strdup(image.source()),
+            .url = strdup(url),
+            .mtime = 0,
+            .version = image.version,
+            .target_width = 0,
+            .target_height = 0,
+            .progressive = true,
+        };
+        _jobs.push_front(job);
+    }
+    _cond.notify_one();
+}
+
+/*
+ * Removes a job that is still waiting in the queue. Returns false when it is already
+ * being decoded (or was never queued).
+ */
+bool ImageLoader::withdraw(unsigned int id, TextureKind kind) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _jobs.begin(); it != _jobs.end(); ++it) {
+        if (it->id == id && it->kind == kind) {
+            free(it->path);
+            free(it->url);
+            _jobs.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Drops every queued job and every decoded image that has not been uploaded yet.
+ * Jobs that are mid decode finish, but their results are thrown away in `poll`
+ * because they carry an older generation.
+ */
+void ImageLoader::cancel() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _generation++;
+    for (auto& job: _jobs) {
+        free(job.path);
+        free(job.url);
+    }
+    _jobs.clear();
+
+    for (auto& decoded: _done)
+        ImageLoader::release(decoded);
+    _done.clear();
+}
+
+/*
+ * VRAM taken by a texture, its mip chain included.
+ */
+size_t ImageLoader::texture_bytes(Texture2D texture) {
+    size_t bytes = 0;
+    int width = texture.width;
+    int height = texture.height;
+    for (int level = 0; level < texture.mipmaps; level++) {
+        bytes += TextureCodec::level_bytes(width, height, texture.format);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return bytes;
+}
+
+const char* ImageLoader::format_name(int format) {
+    switch (format) {
+    case PIXELFORMAT_UNCOMPRESSED_GRAYSCALE: return "R8";
+    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA: return "RG8";
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8: return "RGB8";
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8: return "RGBA8";
+    case PIXELFORMAT_UNCOMPRESSED_R16G16B16: return "RGB16F";
+    case PIXELFORMAT_UNCOMPRESSED_R16G16B16A16: return "RGBA16F";
+    case PIXELFORMAT_COMPRESSED_DXT1_RGB: return "BC1";
+    case PIXELFORMAT_COMPRESSED_DXT5_RGBA: return "BC3";
+    default: return "other";
+    }
+}
+
+/*
+ * Called every frame. Maps the pixel buffers workers wait for and hands every decoded image to the
+ * FrameQueue, which uploads them within the frame budget. Final full images go to the UploadThread
+ * instead when it runs, the textures it finished come back through the FrameQueue to be swapped in.
+ */
+void ImageLoader::poll() {
+    PixelBuffers::update();
+    UploadTask uploaded;
+    while (UploadThread::take(uploaded)) {
+        FrameQueue::push([uploaded]() mutable {
+            return ImageLoader::upload(uploaded);
+        });
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& decoded: _done) {
+        if (UploadThread::running() && decoded.kind == TextureKind::FULL && !decoded.partial && decoded.buffer < 0 && decoded.image.data != NULL) {
+            UploadThread::push(decoded);
+            continue;
+        }
+        UploadTask task = {.decoded = decoded};
+        FrameQueue::push([task]() mutable {
+            return ImageLoader::upload(task);
+        });
+    }
+    _done.clear();
+}
+
+/*
+ * Uploads an Image with every level it has, into a pooled texture of its size when there is one.
+ */
+Texture2D ImageLoader::load_texture(Image& image) {
+    auto texture = TexturePool::acquire(image.width, image.height, image.format, image.mipmaps);
+    // raylib would size the partial blocks of compressed levels wrong.
+    if (texture.id == 0 && image.format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
+        return PixelBuffers::create_texture(image.width, image.height, image.format, image.mipmaps, (const unsigned char*)image.data);
+    if (texture.id == 0)
+        return LoadTextureFromImage(image);
+
+    size_t offset = 0;
+    for (int level = 0; level < image.mipmaps; level++) {
+        int width = std::max(1, image.width >> level);
+        int height = std::max(1, image.height >> level);
+        PixelBuffers::upload_rows(texture, level, 0, height, (const unsigned char*)image.data + offset);
+        offset += TextureCodec::level_bytes(width, height, image.format);
+    }
+    return texture;
+}
+
+/*
+ * Rows of a mip level that make up one strip, whole blocks for compressed formats.
+ */
+static int strip_rows(int width, int format) {
+    if (format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
+        return 4 * std::max<size_t>(1, UPLOAD_STRIP_BYTES / TextureCodec::level_bytes(width, 4, format));
+    return std::max<size_t>(1, UPLOAD_STRIP_BYTES / GetPixelDataSize(width, 1, format));
+}
+
+/*
+ * One step of an upload, run by the FrameQueue. Thumbnails, small images and images in a pixel buffer
+ * are uploaded in one step. Larger ones get their texture allocated and are written a strip of
+ * UPLOAD_STRIP_BYTES per step, level after level, while the texture they replace (if any) is still drawn.
+ * Returns true once the upload is done or thrown away.
+ */
+bool ImageLoader::upload(UploadTask& task) {
+    auto& decoded = task.decoded;
+    unsigned int generation;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        generation = _generation;
+    }
+
+    auto entry = Ryi::find_image(decoded.id);
+    // A pass written into the texture it was decoded for is abandoned when that texture went away.
+    bool replaced = task.in_place && (entry == NULL || entry->state != TextureState::READY || entry->image.id != task.texture.id);
+    // So is a decode of the file's old content that was already running when it was rewritten.
+    bool stale = entry != NULL && decoded.version != entry->version;
+    if (decoded.generation != generation || entry == NULL || replaced || stale) {
+        if (!task.in_place)
+            TexturePool::release(task.texture);
+        ImageLoader::release(decoded);
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto& image = decoded.image;
+    bool buffered = decoded.buffer >= 0;
+    if (!task.started) {
+        task.started = true;
+        if (decoded.width > 0) {
+            entry->width = decoded.width;
+            entry->height = decoded.height;
+        }
+
+        if (decoded.kind == TextureKind::THUMBNAIL) {
+            if (decoded.thumbnails[0].data == NULL) {
+                entry->thumbnail_state = TextureState::FAILED;
+                ImageLoader::release(decoded);
+                return true;
+            }
+
+            size_t bytes = 0;
+            for (int level = 0; level < THUMBNAIL_LEVELS; level++) {
+                auto& thumbnail = entry->thumbnails[level];
+                thumbnail = ImageLoader::load_texture(decoded.thumbnails[level]);
+                SetTextureFilter(thumbnail, TEXTURE_FILTER_TRILINEAR);
+                bytes += ImageLoader::texture_bytes(thumbnail);
+            }
+            _uploaded += bytes;
+            ImageLoader::release(decoded);
+            entry->thumbnail_state = TextureState::READY;
+            TextureCache::insert(entry->id, TextureKind::THUMBNAIL, bytes);
+            return true;
+        }
+
+        if (image.data == NULL && !buffered && !task.uploaded) {
+            if (!entry->refining)
+                entry->state = TextureState::FAILED;
+            entry->refining = false;
+            return true;
+        }
+
+        // Later passes of a progressive decode have the size of the first one and go into its texture.
+        // The final image brings its mip chain, it replaces the pass texture instead.
+        auto& current = entry->image;
+        bool same_size = current.width == image.width && current.height == image.height && current.format == image.format && current.mipmaps == image.mipmaps;
+        if (task.uploaded) {
+            task.level = image.mipmaps;
+        } else if (entry->state == TextureState::READY && same_size && !buffered) {
+            task.in_place = true;
+            task.texture = current;
+        } else if (buffered) {
+            task.texture = PixelBuffers::upload(decoded.buffer, image.width, image.height, image.format, image.mipmaps);
+            decoded.buffer = -1;
+            task.level = image.mipmaps;
+        } else if (ImageLoader::texture_bytes({.width = image.width, .height = image.height, .mipmaps = image.mipmaps, .format = image.format}) <= UPLOAD_STRIP_BYTES) {
+            task.texture = ImageLoader::load_texture(image);
+            task.level = image.mipmaps;
+        } else {
+            // Strips go into a pooled texture of the same size when there is one.
+            task.texture = TexturePool::acquire(image.width, image.height, image.format, image.mipmaps);
+            if (task.texture.id == 0)
+                task.texture = PixelBuffers::create_texture(image.width, image.height, image.format, image.mipmaps, NULL);
+        }
+    }
+
+    if (task.level < image.mipmaps) {
+        int width = std::max(1, image.width >> task.level);
+        int height = std::max(1, image.height >> task.level);
+        int rows = std::min(strip_rows(width, image.format), height - task.row);
+        size_t size = TextureCodec::level_bytes(width, rows, image.format);
+        PixelBuffers::upload_rows(task.texture, task.level, task.row, rows, (const unsigned char*)image.data + task.offset);
+        _uploaded += size;
+        task.offset += size;
+        task.row += rows;
+        if (task.row >= height) {
+            task.level++;
+            task.row = 0;
+        }
+    }
+
+    // Only the time the render loop spends in the calls, the transfer from a pixel buffer happens after them.
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    task.time += elapsed.count();
+    if (task.level < image.mipmaps)
+        return false;
+
+    if (!task.in_place) {
+        // A refined (larger) decode replaces the reduced texture that was drawn until now.
+        if (entry->state == TextureState::READY)
+            entry->unload(TextureKind::FULL);
+        entry->image = task.texture;
+        entry->state = TextureState::READY;
+        // raylib's anisotropic filter only sets the anisotropy, trilinear is what samples the mip chain.
+        SetTextureFilter(entry->image, TEXTURE_FILTER_TRILINEAR);
+        SetTextureFilter(entry->image, TEXTURE_FILTER_ANISOTROPIC_16X);
+        size_t bytes = ImageLoader::texture_bytes(entry->image);
+        TextureCache::insert(entry->id, TextureKind::FULL, bytes);
+        if (task.offset == 0)
+            _uploaded += bytes;
+    }
+    _upload_time[buffered] += task.time;
+    _uploads[buffered]++;
+
+    // While passes are coming in the entry counts as refining, so it is not queued a second time.
+    entry->refining = decoded.partial;
+    if (!decoded.partial && decoded.decode_time > 0)
+        Prefetcher::record_decode(decoded.decode_time);
+    ImageLoader::release(decoded);
+    return true;
+}
+
+bool ImageLoader::busy() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_jobs.empty() || !_done.empty() || _in_flight > 0 || FrameQueue::pending() > 0;
+}
+
+bool ImageLoader::running() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _running;
+}
+
+void ImageLoader::release(DecodedImage& decoded) {
+    UnloadImage(decoded.image);
+    decoded.image = {0};
+    // Only final images hold a buffer, those are released on the main thread.
+    if (decoded.buffer >= 0)
+        PixelBuffers::release(decoded.buffer);
+    decoded.buffer = -1;
+    for (int level = 0; level < THUMBNAIL_LEVELS; level++) {
+        UnloadImage(decoded.thumbnails[level]);
+        decoded.thumbnails[level] = {0};
+    }
+}
+
+/*
+ * Hands an intermediate pass to the render loop. A pass that is still waiting for its upload
+ * is replaced, only the newest one is worth drawing.
+ */
+void ImageLoader::publish_pass(DecodeJob& job, unsigned int generation, Image pass) {
+    DecodedImage partial = {.id = job.id, .kind = job.kind, .image = ImageCopy(pass), .generation = generation, .version = job.version, .partial = true, .buffer = -1};
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto it = _done.begin(); it != _done.end(); ++it) {
+        if (it->id == job.id && it->kind == job.kind && it->partial) {
+            ImageLoader::release(*it);
+            _done.erase(it);
+            break;
+        }
+    }
+    _done.push_back(partial);
+    Idle::wake();
+}
+
+static Image decode_raylib(FileFormat format, const unsigned char* data, size_t size, int, int, int* width, int* height) {
+    auto image = LoadImageFromMemory(FileFormats::extension(format), data, (int)size);
+    *width = image.width;
+    *height = image.height;
+    return image;
+}
+
+// libjpeg scales in the DCT domain, raylib is the fallback for the JPEGs it refuses (CMYK).
+static Image decode_jpeg(FileFormat format, const unsigned char* data, size_t size, int target_width, int target_height, int* width, int* height) {
+    auto image = JpegDecoder::decode(data, size, target_width, target_height, width, height);
+    if (image.data == NULL)
+        image = decode_raylib(format, data, size, target_width, target_height, width, height);
+    return image;
+}
+
+struct PngSource {
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+};
+
+static void png_source_read(png_structp png, png_bytep out, size_t length) {
+    auto source = (PngSource*)png_get_io_ptr(png);
+    if (source->offset + length > source->size)
+        png_error(png, "truncated");
+    memcpy(out, source->data + source->offset, length);
+    source->offset += length;
+}
+
+static void png_source_warning(png_structp, png_const_charp) {
+}
+
+/*
+ * Half float bits of every 16 bit channel value (0 to 65535 mapped to 0 to 1), built on first use.
+ */
+static const unsigned short* half_table() {
+    static std::vector<unsigned short> table = []() {
+        std::vector<unsigned short> halves(65536);
+        for (unsigned int value = 0; value < 65536; value++) {
+            float unit = value / 65535.0f;
+            unsigned int bits;
+            memcpy(&bits, &unit, sizeof(bits));
+            int exponent = (int)((bits >> 23) & 0xFF) - 112;
+            unsigned int mantissa = bits & 0x7FFFFF;
+            if (value == 0 || exponent < -10) {
+                halves[value] = 0;
+            } else if (exponent <= 0) {
+                // Subnormal half, rounded to nearest.
+                mantissa |= 0x800000;
+                int shift = 14 - exponent;
+                halves[value] = (unsigned short)((mantissa + (1u << (shift - 1))) >> shift);
+            } else {
+                halves[value] = (unsigned short)(((exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+            }
+        }
+        return halves;
+    }();
+    return table.data();
+}
+
+/*
+ * Decodes a 16 bit PNG into a half float RGB(A) image, gray files are expanded to RGB since raylib
+ * swizzles only its 8 bit gray formats. The big endian samples libpng writes are turned into halves in place.
+ */
+static Image decode_png16(const unsigned char* data, size_t size) {
+    PngSource source = {.data = data, .size = size, .offset = 0};
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, png_source_warning);
+    png_infop info = png != NULL ? png_create_info_struct(png) : NULL;
+    unsigned char* volatile pixels = NULL;
+    png_bytep* volatile rows = NULL;
+    if (info == NULL) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return (Image){0};
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        free(pixels);
+        free(rows);
+        return (Image){0};
+    }
+
+    png_set_read_fn(png, &source, png_source_read);
+    png_read_info(png, info);
+    png_set_expand(png);
+    png_set_gray_to_rgb(png);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+    int width = png_get_image_width(png, info);
+    int height = png_get_image_height(png, info);
+    int channels = png_get_channels(png, info);
+    size_t stride = png_get_rowbytes(png, info);
+
+    pixels = (unsigned char*)malloc(stride * height);
+    rows = (png_bytep*)malloc(sizeof(png_bytep) * height);
+    for (int y = 0; y < height; y++)
+        rows[y] = pixels + stride * y;
+    png_read_image(png, rows);
+    png_destroy_read_struct(&png, &info, NULL);
+    free(rows);
+
+    const unsigned short* halves = half_table();
+    auto samples = (unsigned short*)pixels;
+    for (size_t i = 0; i < stride * height / 2; i++)
+        samples[i] = halves[(pixels[i * 2] << 8) | pixels[i * 2 + 1]];
+
+    return (Image){
+        .data = pixels,
+        .width = width,
+        .height = height,
+        .mipmaps = 1,
+        .format = channels == 4 ? PIXELFORMAT_UNCOMPRESSED_R16G16B16A16 : PIXELFORMAT_UNCOMPRESSED_R16G16B16,
+    };
+}
+
+/*
+ * Decodes a PNG a row at a time and box filters every `factor` x `factor` block of pixels into one while
+ * it goes, so only a row of sums is ever held at full width. Thumbnails of images far too large for a
+ * texture (the ones DeepZoom draws) cost the size of the thumbnail instead of the whole image.
+ * Interlaced files have no full row before the last pass, they return an empty Image.
+ */
+static Image decode_png_scaled(const unsigned char* data, size_t size, int factor, int* width, int* height) {
+    PngSource source = {.data = data, .size = size, .offset = 0};
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, png_source_warning);
+    png_infop info = png != NULL ? png_create_info_struct(png) : NULL;
+    unsigned char* volatile pixels = NULL;
+    unsigned char* volatile row = NULL;
+    unsigned int* volatile sums = NULL;
+    if (info == NULL) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return (Image){0};
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        free(pixels);
+        free(row);
+        free(sums);
+        return (Image){0};
+    }
+
+    png_set_read_fn(png, &source, png_source_read);
+    png_read_info(png, info);
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+        png_destroy_read_struct(&png, &info, NULL);
+        return (Image){0};
+    }
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_read_update_info(png, info);
+    int source_width = png_get_image_width(png, info);
+    int source_height = png_get_image_height(png, info);
+    int channels = png_get_channels(png, info);
+    int scaled_width = (source_width + factor - 1) / factor;
+    int scaled_height = (source_height + factor - 1) / factor;
+    size_t stride = (size_t)scaled_width * channels;
+
+    pixels = (unsigned char*)malloc(stride * scaled_height);
+    row = (unsigned char*)malloc(png_get_rowbytes(png, info));
+    sums = (unsigned int*)calloc(stride, sizeof(unsigned int));
+    for (int y = 0; y < source_height; y++) {
+        png_read_row(png, row, NULL);
+        for (int x = 0; x < source_width; x++) {
+            for (int c = 0; c < channels; c++)
+                sums[(x / factor) * channels + c] += row[x * channels + c];
+        }
+
+        // The last column and row of blocks may be narrower than `factor`.
+        int rows = y % factor + 1;
+        if (rows < factor && y < source_height - 1)
+            continue;
+        auto out = pixels + stride * (y / factor);
+        for (int x = 0; x < scaled_width; x++) {
+            int count = std::min(factor, source_width - x * factor) * rows;
+            for (int c = 0; c < channels; c++)
+                out[x * channels + c] = (unsigned char)((sums[x * channels + c] + count / 2) / count);
+        }
+        memset(sums, 0, stride * sizeof(unsigned int));
+    }
+    png_destroy_read_struct(&png, &info, NULL);
+    free(row);
+    free(sums);
+
+    *width = source_width;
+    *height = source_height;
+    return (Image){
+        .data = pixels,
+        .width = scaled_width,
+        .height = scaled_height,
+        .mipmaps = 1,
+        .format =
+            channels == 1 ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE :
+            channels == 2 ? PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA :
+            channels == 3 ? PIXELFORMAT_UNCOMPRESSED_R8G8B8 : PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+}
+
+// raylib cuts 16 bit PNGs down to 8 bits, they keep their depth only when high precision is asked for (`-p`).
+// Files at least twice the size asked for are scaled while they decode, at 8 bits, a closer look decodes them again.
+static Image decode_png(FileFormat format, const unsigned char* data, size_t size, int target_width, int target_height, int* width, int* height) {
+    // Width and height are the first fields of the IHDR chunk, the bit depth the first byte after them.
+    if (target_width > 0 && target_height > 0 && size > 24) {
+        int source_width = (data[16] << 24) | (data[17] << 16) | (data[18] << 8) | data[19];
+        int source_height = (data[20] << 24) | (data[21] << 16) | (data[22] << 8) | data[23];
+        int factor = std::min(source_width / target_width, source_height / target_height);
+        if (factor >= 2) {
+            auto image = decode_png_scaled(data, size, factor, width, height);
+            if (image.data != NULL)
+                return image;
+        }
+    }
+    if (ImageLoader::high_precision && size > 24 && data[24] == 16) {
+        auto image = decode_png16(data, size);
+        if (image.data != NULL) {
+            *width = image.width;
+            *height = image.height;
+            return image;
+        }
+    }
+    return decode_raylib(format, data, size, target_width, target_height, width, height);
+}
+
+// Only the first frame, the Animation decodes the rest while it plays.
+static Image decode_gif(FileFormat, const unsigned char* data, size_t size, int, int, int* width, int* height) {
+    return GifDecoder::decode(data, size, width, height);
+}
+
+using DecodeFunction = Image (*)(FileFormat, const unsigned char*, size_t, int, int, int*, int*);
+
+/*
+ * The decoder of every FileFormat, indexed by the format itself.
+ */
+static const struct {
+    FileFormat format;
+    DecodeFunction decode;
+} DECODERS[] = {
+    {FileFormat::UNKNOWN, NULL},
+    {FileFormat::PNG, decode_png},
+    {FileFormat::JPEG, decode_jpeg},
+    {FileFormat::BMP, decode_raylib},
+    {FileFormat::GIF, decode_gif},
+};
+
+static_assert(sizeof(DECODERS) / sizeof(DECODERS[0]) == (size_t)FileFormat::GIF + 1, "every FileFormat needs a decoder");
+
+/*
+ * Decodes the job's file from a memory mapping with the decoder its magic bytes select, whatever the
+ * file is named. Progressive JPEGs and interlaced PNGs of progressive jobs publish their passes along the way.
+ * `width` and `height` receive the native size of the image, which may be larger than the result,
+ * `format` (when given) the format that was detected.
+ */
+Image ImageLoader::decode(DecodeJob& job, unsigned int generation, int* width, int* height, FileFormat* detected) {
+    MappedFile file;
+    if (!file.open(job.path))
+        return (Image){0};
+
+    Image image = {0};
+    auto format = FileFormats::from_magic(file.data(), file.size());
+    if (detected != NULL)
+        *detected = format;
+    if (job.progressive && ProgressiveDecoder::is_progressive(format, file.data(), file.size())) {
+        ProgressiveDecoder decoder(job.target_width, job.target_height, [&job, generation](Image pass) {
+            ImageLoader::publish_pass(job, generation, pass);
+        });
+        decoder.decode(file.data(), file.size());
+        image = decoder.finish(width, height);
+    } else if (DECODERS[(int)format].decode != NULL) {
+        image = DECODERS[(int)format].decode(format, file.data(), file.size(), job.target_width, job.target_height, width, height);
+    }
+    file.close();
+    return image;
+}
+
+/*
+ * Builds the thumbnail pyramid from the largest level down, each level resized from the one above it
+ * so the big source image is only read once. Images smaller than a level are never upscaled.
+ */
+void ImageLoader::build_thumbnails(Image source, Image* levels) {
+    Image previous = source;
+    for (int level = THUMBNAIL_LEVELS - 1; level >= 0; level--) {
+        float size = THUMBNAIL_SIZES[level];
+        float scale = size / (source.width > source.height ? source.width : source.height);
+        if (scale > 1.0f) scale = 1.0f;
+
+        int width = (int)(source.width * scale);
+        int height = (int)(source.height * scale);
+        levels[level] = ImageCopy(previous);
+        if (width < 1) width = 1;
+        if (height < 1) height = 1;
+        if (width != previous.width || height != previous.height)
+            ImageResize(&levels[level], width, height);
+        previous = levels[level];
+    }
+}
+
+/*
+ * Appends the mip chain to a decoded image. Done here on the worker, the upload then sends every level
+ * at once and minified draws (fit to window, zoomed out, grid cells) sample a level close to their size
+ * instead of aliasing over the full resolution texture.
+ */
+void ImageLoader::build_mipmaps(Image& image) {
+    if (image.data != NULL && image.mipmaps == 1 && (image.width > 1 || image.height > 1))
+        ImageMipmaps(&image);
+}
+
+/*
+ * Drops the channels the pixels do not use: an alpha that is opaque everywhere (PNGs are often written
+ * as RGBA regardless) and the color of gray images (scans saved as RGB). Gray textures are a single
+ * channel that raylib swizzles back to gray, so the upload and the VRAM shrink with the pixel size.
+ */
+void ImageLoader::narrow(Image& image) {
+    int channels;
+    switch (image.format) {
+    case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA: channels = 2; break;
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8: channels = 3; break;
+    case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8: channels = 4; break;
+    default: return;
+    }
+    if (image.data == NULL || image.mipmaps != 1)
+        return;
+
+    auto pixels = (unsigned char*)image.data;
+    size_t count = (size_t)image.width * image.height;
+    bool opaque = channels != 3;
+    bool gray = channels >= 3;
+    for (size_t i = 0; i < count && (opaque || gray); i++) {
+        const unsigned char* pixel = pixels + i * channels;
+        if (opaque && pixel[channels - 1] != 255)
+            opaque = false;
+        if (gray && (pixel[0] != pixel[1] || pixel[0] != pixel[2]))
+            gray = false;
+    }
+    if (!opaque && !gray)
+        return;
+
+    int colors = gray || channels == 2 ? 1 : 3;
+    int alpha = channels != 3 && !opaque ? 1 : 0;
+    int narrowed = colors + alpha;
+    // Narrower pixels never overtake the wider ones they are read from, the copy works in place.
+    for (size_t i = 0; i < count; i++) {
+        unsigned char pixel[4];
+        memcpy(pixel, pixels + i * channels, channels);
+        memcpy(pixels + i * narrowed, pixel, colors);
+        if (alpha)
+            pixels[i * narrowed + colors] = pixel[channels - 1];
+    }
+    image.data = realloc(pixels, count * narrowed);
+    image.format = narrowed == 1 ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE : narrowed == 2 ? PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA : PIXELFORMAT_UNCOMPRESSED_R8G8B8;
+}
+
+/*
+ * Readies a decoded full image for its upload. GIFs stay RGBA, the animation writes its frames into the
+ * texture, and half float images stay as they are. The rest is compressed when that is asked for and
+ * narrowed otherwise. The UploadThread builds the chain of uncompressed images on the GPU.
+ */
+void ImageLoader::prepare(Image& image, FileFormat format) {
+    bool keep = format == FileFormat::GIF || image.format == PIXELFORMAT_UNCOMPRESSED_R16G16B16 || image.format == PIXELFORMAT_UNCOMPRESSED_R16G16B16A16;
+    if (!keep && TextureCodec::compress(image))
+        return;
+    if (!keep)
+        ImageLoader::narrow(image);
+    if (!UploadThread::running())
+        ImageLoader::build_mipmaps(image);
+}
+
+/*
+ * Copies a prepared full image, its mip chain included, into a pixel buffer when one can be had. The copy
+ * happens here on the worker, the render loop later only points GL at the buffer. The pixels are freed,
+ * the Image keeps describing them.
+ */
+void ImageLoader::stage(DecodedImage& decoded) {
+    auto& image = decoded.image;
+    if (image.data == NULL || UploadThread::running())
+        return;
+
+    size_t size = 0;
+    for (int level = 0, width = image.width, height = image.height; level < image.mipmaps; level++) {
+        size += TextureCodec::level_bytes(width, height, image.format);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    int slot = PixelBuffers::acquire(size);
+    if (slot < 0)
+        return;
+
+    memcpy(PixelBuffers::data(slot), image.data, size);
+    UnloadImage(image);
+    image.data = NULL;
+    decoded.buffer = slot;
+}
+
+void ImageLoader::worker() {
+    while (true) {
+        DecodeJob job;
+        unsigned int generation;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, []() { return !_running || !_jobs.empty(); });
+            if (!_running)
+                return;
+            job = _jobs.front();
+            _jobs.pop_front();
+            generation = _generation;
+            _in_flight++;
+        }
+
+        DecodedImage decoded = {.id = job.id, .kind = job.kind, .generation = generation, .version = job.version, .buffer = -1};
+        if (job.kind == TextureKind::THUMBNAIL) {
+            ImageLoader::decode_thumbnails(job, decoded);
+        } else if (job.url != NULL) {
+            ImageLoader::fetch(job, decoded);
+        } else {
+            long rss_before = MappedFile::peak_rss_kb();
+            auto start = std::chrono::steady_clock::now();
+            FileFormat format = FileFormat::UNKNOWN;
+            decoded.image = ImageLoader::decode(job, generation, &decoded.width, &decoded.height, &format);
+            ImageLoader::prepare(decoded.image, format);
+            ImageLoader::stage(decoded);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            decoded.decode_time = elapsed.count();
+            TraceLog(LOG_INFO, "RYI: Peak RSS %ld KB before loading `%s`, %ld KB after", rss_before, job.path, MappedFile::peak_rss_kb());
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _in_flight--;
+            _done.push_back(decoded);
+            Idle::wake();
+        }
+        free(job.path);
+        free(job.url);
+    }
+}
+
+struct Download {
+    FILE* file;
+    ProgressiveDecoder* decoder;
+};
+
+static size_t download_write(char* data, size_t size, size_t count, void* user) {
+    auto download = (Download*)user;
+    size_t bytes = size * count;
+    if (fwrite(data, 1, bytes, download->file) != bytes)
+        return 0;
+    download->decoder->feed((const unsigned char*)data, bytes);
+    return bytes;
+}
+
+// Aborts the transfer when the viewer is closed mid download.
+static int download_progress(void*, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return ImageLoader::running() ? 0 : 1;
+}
+
+/*
+ * Downloads the job's url to its path. The bytes are fed to a ProgressiveDecoder as they arrive, so
+ * the passes of a progressive file are drawn while the rest is still on the wire. The file on disk
+ * is what later decodes (after an eviction) read from. No decode time is reported, the transfer would
+ * dominate it and throw the Prefetcher's estimate off.
+ */
+void ImageLoader::fetch(DecodeJob& job, DecodedImage& decoded) {
+    long rss_before = MappedFile::peak_rss_kb();
+    unsigned int generation = decoded.generation;
+    ProgressiveDecoder decoder(job.target_width, job.target_height, [&job, generation](Image pass) {
+        ImageLoader::publish_pass(job, generation, pass);
+    });
+
+    FILE* file = fopen(job.path, "wb");
+    CURL* curl = file != NULL ? curl_easy_init() : NULL;
+    if (curl) {
+        Download download = {.file = file, .decoder = &decoder};
+        curl_easy_setopt(curl, CURLOPT_URL, job.url);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, download_write);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, download_progress);
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+        CURLcode res = curl_easy_perform(curl);
+
+        if (res == CURLE_OK)
+            printf("Image downloaded to temp storage successfully.\n");
+        else
+            TraceLog(LOG_WARNING, "RYI: Failed fetching `%s`: %s", job.url, curl_easy_strerror(res));
+        curl_easy_cleanup(curl);
+
+        if (res == CURLE_OK) {
+            decoded.image = decoder.finish(&decoded.width, &decoded.height);
+            ImageLoader::prepare(decoded.image, Ryi::file_format(GetFileExtension(job.url)));
+            ImageLoader::stage(decoded);
+        }
+    }
+    if (file != NULL)
+        fclose(file);
+
+    TraceLog(LOG_INFO, "RYI: Peak RSS %ld KB before loading `%s`, %ld KB after", rss_before, job.url, MappedFile::peak_rss_kb());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _in_flight--;
+    _done.push_back(decoded);
+    Idle::wake();
+}
+
+/*
+ * Thumbnail jobs try the freedesktop cache first and only decode the source file on a miss.
+ * A freshly built pyramid is handed to the render loop before it is written back to the cache,
+ * the PNG encoding happens on copies while the grid is already drawing it.
+ */
+void ImageLoader::decode_thumbnails(DecodeJob& job, DecodedImage& decoded) {
+    Image cached = {0};
+    Image levels[THUMBNAIL_LEVELS] = {0};
+    if (job.mtime != 0 && ThumbnailCache::load(job.path, job.mtime, &cached, &decoded.width, &decoded.height)) {
+        ImageLoader::build_thumbnails(cached, decoded.thumbnails);
+        UnloadImage(cached);
+    } else {
+        auto image = ImageLoader::decode(job, decoded.generation, &decoded.width, &decoded.height);
+        // Thumbnails are written to the cache as 8 bit PNGs.
+        if (image.format == PIXELFORMAT_UNCOMPRESSED_R16G16B16 || image.format == PIXELFORMAT_UNCOMPRESSED_R16G16B16A16)
+            ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        if (image.data != NULL) {
+            ImageLoader::build_thumbnails(image, decoded.thumbnails);
+            // Level 0 (64 px) has no freedesktop size, it is never written.
+            if (job.mtime != 0) {
+                for (int level = 1; level < THUMBNAIL_LEVELS; level++)
+                    levels[level] = ImageCopy(decoded.thumbnails[level]);
+            }
+        }
+        UnloadImage(image);
+    }
+    // The cache copies above are taken first, thumbnails are stored without their chains.
+    for (int level = 0; level < THUMBNAIL_LEVELS; level++) {
+        ImageLoader::narrow(decoded.thumbnails[level]);
+        ImageLoader::build_mipmaps(decoded.thumbnails[level]);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _in_flight--;
+        _done.push_back(decoded);
+        Idle::wake();
+    }
+
+    if (levels[1].data != NULL) {
+        ThumbnailCache::store(job.path, job.mtime, decoded.width, decoded.height, levels);
+        for (int level = 1; level < THUMBNAIL_LEVELS; level++)
+            UnloadImage(levels[level]);
+    }
+}
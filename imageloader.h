@@ -0,0 +1,137 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <raylib.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <condition_variable>
+#include "renderimage.h"
+
+// Bytes an upload writes per FrameQueue step, larger images take several steps (and frames).
+const size_t UPLOAD_STRIP_BYTES = 2ul * 1024 * 1024;
+
+/*
+ * DecodeJob struct.
+ * A request to decode the file at `path` for the catalog entry with the given id,
+ * either as a full image or as a thumbnail pyramid. The loader owns its own copy of the path.
+ * `mtime` is zero when the result must not go through the on-disk ThumbnailCache. `version` is the entry's
+ * version of the file when the job was queued.
+ * Decoders that can scale while decoding stop at the first size covering `target_width` x `target_height`.
+ * `progressive` jobs publish the intermediate passes of progressive files while they decode. Jobs with
+ * a `url` download it to `path` first, decoding the bytes as they come in.
+ */
+struct DecodeJob {
+    unsigned int id;
+    TextureKind kind;
+    char* path;
+    char* url;
+    time_t mtime;
+    unsigned int version;
+    int target_width;
+    int target_height;
+    bool progressive;
+};
+
+/*
+ * DecodedImage struct.
+ * The result of a decode job. Holds the CPU side raylib Image (or every level of the thumbnail pyramid),
+ * the source dimensions and the catalog entry (and `version` of its file) it belongs to. `partial` images are intermediate passes,
+ * the final image of the same job follows them. A final image that was copied into a pixel buffer keeps
+ * only its description, `buffer` is the slot its pixels are in (-1 when they are in `image`).
+ */
+struct DecodedImage {
+    unsigned int id;
+    TextureKind kind;
+    Image image;
+    Image thumbnails[THUMBNAIL_LEVELS];
+    int width;
+    int height;
+    unsigned int generation;
+    unsigned int version;
+    double decode_time;
+    bool partial;
+    int buffer;
+};
+
+/*
+ * UploadTask struct.
+ * A decoded image on its way to the GPU. Large images are written into `texture` a strip at a time,
+ * `level`, `row` and `offset` are where the next strip starts. `in_place` passes go into the texture
+ * that is already drawn, `uploaded` images come with the texture the UploadThread made for them.
+ * `time` adds up the render loop time spent on every step.
+ */
+struct UploadTask {
+    DecodedImage decoded;
+    Texture2D texture;
+    int level;
+    int row;
+    size_t offset;
+    bool started;
+    bool in_place;
+    bool uploaded;
+    double time;
+};
+
+/*
+ * ImageLoader struct.
+ * Decodes image files on a pool of worker threads. Workers only produce CPU side Images,
+ * raylib's GL calls must stay on the main thread, so the render loop calls `poll` every frame
+ * to queue the uploads of whatever finished decoding since the last frame on the FrameQueue.
+ */
+struct ImageLoader {
+public:
+    static void start(int workers = 0);
+    static void stop();
+    static void request(RenderImage& image, TextureKind kind, bool urgent = false, float width = 0, float height = 0);
+    static void download(RenderImage& image, const char* url);
+    static bool withdraw(unsigned int id, TextureKind kind);
+    static void cancel();
+    static void poll();
+    static bool busy();
+    static bool running();
+    static size_t texture_bytes(Texture2D texture);
+    static const char* format_name(int format);
+    static size_t uploaded() { return _uploaded; }
+    static double upload_time(bool buffered) { return _uploads[buffered] > 0 ? _upload_time[buffered] / _uploads[buffered] : 0; }
+
+    static bool high_precision;
+
+private:
+    static void worker();
+    static Image decode(DecodeJob&, unsigned int, int*, int*, FileFormat* = NULL);
+    static void fetch(DecodeJob&, DecodedImage&);
+    static void publish_pass(DecodeJob&, unsigned int, Image);
+    static void build_thumbnails(Image, Image*);
+    static void build_mipmaps(Image&);
+    static void narrow(Image&);
+    static void prepare(Image&, FileFormat);
+    static void stage(DecodedImage&);
+    static bool upload(UploadTask&);
+    static Texture2D load_texture(Image&);
+    static void decode_thumbnails(DecodeJob&, DecodedImage&);
+    static void release(DecodedImage&);
+
+    static std::vector<std::thread> _workers;
+    static std::deque<DecodeJob> _jobs;
+    static std::deque<DecodedImage> _done;
+    static std::mutex _mutex;
+    static std::condition_variable _cond;
+    static unsigned int _generation;
+    static int _in_flight;
+    static bool _running;
+    static size_t _uploaded;
+    static double _upload_time[2];
+    static size_t _uploads[2];
+};
+
+#endif // IMAGELOADER_H
@@ -0,0 +1,211 @@
+#include "imageprobe.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+static bool read_at(ProbeSource& source, long offset, unsigned char* buffer, size_t size) {
+    if (source.head != NULL && offset + size <= source.head_size) {
+        memcpy(buffer, source.head + offset, size);
+        return true;
+    }
+    return pread(source.fd, buffer, size, offset) == (ssize_t)size;
+}
+
+static int be16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+static int le16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+static unsigned int be32(const unsigned char* p) { return ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static int le32(const unsigned char* p) { return (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24)); }
+
+bool ImageProbe::probe(int fd, FileFormat format, ImageInfo& info) {
+    return ImageProbe::probe((ProbeSource){.fd = fd, .head = NULL, .head_size = 0}, format, info);
+}
+
+bool ImageProbe::probe(ProbeSource source, FileFormat format, ImageInfo& info) {
+    info = {0, 0, 0, 0, 0};
+    switch (format) {
+    case FileFormat::PNG: return ImageProbe::probe_png(source, info);
+    case FileFormat::JPEG: return ImageProbe::probe_jpeg(source, info);
+    case FileFormat::GIF: return ImageProbe::probe_gif(source, info);
+    case FileFormat::BMP: return ImageProbe::probe_bmp(source, info);
+    default: return false;
+    }
+}
+
+/*
+ * Works out what the file really is. The format guessed from the extension is probed first, that is
+ * right for nearly every file, only when it is wrong (or there was no guess) the magic bytes decide.
+ * Returns UNKNOWN for anything that is not an image, without any decoder having seen it.
+ */
+FileFormat ImageProbe::identify(ProbeSource source, FileFormat guess, ImageInfo& info) {
+    if (guess != FileFormat::UNKNOWN && ImageProbe::probe(source, guess, info))
+        return guess;
+
+    unsigned char magic[FileFormats::MAGIC_SIZE];
+    if (!read_at(source, 0, magic, sizeof(magic)))
+        return FileFormat::UNKNOWN;
+
+    auto format = FileFormats::from_magic(magic, sizeof(magic));
+    if (format == FileFormat::UNKNOWN || format == guess || !ImageProbe::probe(source, format, info))
+        return FileFormat::UNKNOWN;
+    return format;
+}
+
+bool ImageProbe::probe_png(ProbeSource& source, ImageInfo& info) {
+    unsigned char header[26];
+    if (!read_at(source, 0, header, sizeof(header)))
+        return false;
+    if (memcmp(header, "\x89PNG\r\n\x1a\n", 8) != 0 || memcmp(header + 12, "IHDR", 4) != 0)
+        return false;
+
+    info.width = (int)be32(header + 16);
+    info.height = (int)be32(header + 20);
+    info.bit_depth = header[24];
+    switch (header[25]) {
+    case 0: info.channels = 1; break;   // grayscale
+    case 2: info.channels = 3; break;   // rgb
+    case 3: info.channels = 3; break;   // palette
+    case 4: info.channels = 2; break;   // grayscale + alpha
+    case 6: info.channels = 4; break;   // rgba
+    default: return false;
+    }
+    return info.width > 0 && info.height > 0;
+}
+
+/*
+ * Reads an EXIF "YYYY:MM:DD HH:MM:SS" stamp as if it was UTC, the camera's time zone is unknown
+ * and only the order of the stamps matters.
+ */
+static time_t exif_time(const unsigned char* text) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf((const char*)text, "%4d:%2d:%2d %2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return 0;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return timegm(&tm);
+}
+
+/*
+ * Finds DateTimeOriginal in the EXIF sub IFD of a TIFF block, or DateTime in IFD0 when there is none.
+ */
+static time_t exif_capture_time(const unsigned char* tiff, size_t size) {
+    if (size < 8) return 0;
+    bool little = tiff[0] == 'I' && tiff[1] == 'I';
+    if (!little && !(tiff[0] == 'M' && tiff[1] == 'M')) return 0;
+    auto u16 = [&](size_t at) -> unsigned int { return little ? le16(tiff + at) : be16(tiff + at); };
+    auto u32 = [&](size_t at) -> unsigned int { return little ? (unsigned int)le32(tiff + at) : be32(tiff + at); };
+
+    time_t modified = 0;
+    size_t ifd = u32(4);
+    for (int depth = 0; depth < 2 && ifd + 2 <= size; depth++) {
+        unsigned int count = u16(ifd);
+        size_t next = 0;
+        for (unsigned int i = 0; i < count && ifd + 2 + (i + 1) * 12 <= size; i++) {
+            size_t entry = ifd + 2 + i * 12;
+            unsigned int tag = u16(entry);
+            size_t value = u32(entry + 8);
+            if (tag == 0x8769)   // ExifIFD pointer
+                next = value;
+            else if ((tag == 0x9003 || tag == 0x0132) && value + 19 <= size) {   // DateTimeOriginal, DateTime
+                char stamp[20];
+                memcpy(stamp, tiff + value, 19);
+                stamp[19] = '\0';
+                time_t time = exif_time((const unsigned char*)stamp);
+                if (tag == 0x9003 && time != 0) return time;
+                if (tag == 0x0132) modified = time;
+            }
+        }
+        if (next == 0) break;
+        ifd = next;
+    }
+    return modified;
+}
+
+/*
+ * Walks the marker segments (skipping APPn blocks by their length) until the first start of frame.
+ * Only the 2 to 4 byte segment headers are read, plus the body of an EXIF APP1 for the capture time.
+ */
+bool ImageProbe::probe_jpeg(ProbeSource& source, ImageInfo& info) {
+    unsigned char buffer[10];
+    if (!read_at(source, 0, buffer, 2) || buffer[0] != 0xFF || buffer[1] != 0xD8)
+        return false;
+
+    long offset = 2;
+    for (int segments = 0; segments < 1024; segments++) {
+        if (!read_at(source, offset, buffer, 2) || buffer[0] != 0xFF)
+            return false;
+
+        int marker = buffer[1];
+        if (marker == 0xFF) {   // fill byte
+            offset++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {   // markers without a length
+            offset += 2;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA)   // end of image or start of scan before any frame
+            return false;
+
+        if (!read_at(source, offset + 2, buffer, 2))
+            return false;
+        int length = be16(buffer);
+
+        if (marker == 0xE1 && length > 14 && info.capture_time == 0) {
+            std::vector<unsigned char> exif(length - 2);
+            if (read_at(source, offset + 4, exif.data(), exif.size()) && memcmp(exif.data(), "Exif\0\0", 6) == 0)
+                info.capture_time = exif_capture_time(exif.data() + 6, exif.size() - 6);
+        }
+
+        bool start_of_frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (start_of_frame) {
+            if (length < 8 || !read_at(source, offset + 4, buffer, 6))
+                return false;
+            info.bit_depth = buffer[0];
+            info.height = be16(buffer + 1);
+            info.width = be16(buffer + 3);
+            info.channels = buffer[5];
+            return info.width > 0 && info.height > 0;
+        }
+        offset += 2 + length;
+    }
+    return false;
+}
+
+bool ImageProbe::probe_gif(ProbeSource& source, ImageInfo& info) {
+    unsigned char header[10];
+    if (!read_at(source, 0, header, sizeof(header)))
+        return false;
+    if (memcmp(header, "GIF87a", 6) != 0 && memcmp(header, "GIF89a", 6) != 0)
+        return false;
+
+    info.width = le16(header + 6);
+    info.height = le16(header + 8);
+    info.channels = 4;
+    info.bit_depth = 8;
+    return info.width > 0 && info.height > 0;
+}
+
+bool ImageProbe::probe_bmp(ProbeSource& source, ImageInfo& info) {
+    unsigned char header[30];
+    if (!read_at(source, 0, header, sizeof(header)) || header[0] != 'B' || header[1] != 'M')
+        return false;
+
+    int bits;
+    if (le32(header + 14) == 12) {   // BITMAPCOREHEADER
+        info.width = le16(header + 18);
+        info.height = le16(header + 20);
+        bits = le16(header + 24);
+    } else {
+        info.width = le32(header + 18);
+        info.height = le32(header + 22);
+        bits = le16(header + 28);
+    }
+
+    if (info.height < 0) info.height = -info.height;   // top-down bitmap
+    info.channels = bits == 32 ? 4 : 3;   // paletted and 16 bit bitmaps decode to rgb
+    info.bit_depth = 8;
+    return info.width > 0 && info.height > 0;
+}
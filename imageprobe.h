@@ -0,0 +1,58 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef IMAGEPROBE_H
+#define IMAGEPROBE_H
+
+#include <stddef.h>
+#include <time.h>
+#include "fileformat.h"
+
+/*
+ * ImageInfo struct.
+ * What can be learned about an image from its header alone. `capture_time` comes from the EXIF
+ * block of JPEGs, it is zero for everything else.
+ */
+struct ImageInfo {
+    int width;
+    int height;
+    int channels;
+    int bit_depth;
+    time_t capture_time;
+};
+
+/*
+ * ProbeSource struct.
+ * Where a probe reads from: `head` holds the first bytes of the file when the caller read them already
+ * (batched io_uring reads), anything past them is read from `fd`.
+ */
+struct ProbeSource {
+    int fd;
+    const unsigned char* head;
+    size_t head_size;
+};
+
+/*
+ * ImageProbe struct.
+ * Reads the PNG IHDR, the JPEG SOFn segment, the GIF logical screen descriptor or the BMP info header
+ * with a handful of small preads, so layout code gets image dimensions without decoding any pixels.
+ */
+struct ImageProbe {
+public:
+    static bool probe(int fd, FileFormat format, ImageInfo& info);
+    static bool probe(ProbeSource source, FileFormat format, ImageInfo& info);
+    static FileFormat identify(ProbeSource source, FileFormat guess, ImageInfo& info);
+
+private:
+    static bool probe_png(ProbeSource& source, ImageInfo& info);
+    static bool probe_jpeg(ProbeSource& source, ImageInfo& info);
+    static bool probe_gif(ProbeSource& source, ImageInfo& info);
+    static bool probe_bmp(ProbeSource& source, ImageInfo& info);
+};
+
+#endif // IMAGEPROBE_H
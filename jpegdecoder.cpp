@@ -0,0 +1,85 @@
+#include "jpegdecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+struct JpegError {
+    jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void jpeg_error_exit(j_common_ptr info) {
+    longjmp(((JpegError*)info->err)->jump, 1);
+}
+
+static void jpeg_output_message(j_common_ptr) {
+}
+
+/*
+ * Decodes at the smallest DCT scale that still gives at least `target_width` x `target_height` pixels
+ * (a target of 0 means full size). `width` and `height` receive the native size of the image.
+ * Returns an empty Image for anything libjpeg can not turn into grayscale or RGB (CMYK for instance),
+ * callers fall back to raylib's decoder then.
+ */
+Image JpegDecoder::decode(const unsigned char* data, size_t size, int target_width, int target_height, int* width, int* height) {
+    jpeg_decompress_struct info;
+    JpegError error;
+    unsigned char* volatile pixels = NULL;
+
+    info.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpeg_error_exit;
+    error.manager.output_message = jpeg_output_message;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_decompress(&info);
+        free(pixels);
+        return (Image){0};
+    }
+
+    jpeg_create_decompress(&info);
+    jpeg_mem_src(&info, data, size);
+    jpeg_read_header(&info, TRUE);
+    *width = info.image_width;
+    *height = info.image_height;
+
+    if (info.jpeg_color_space == JCS_CMYK || info.jpeg_color_space == JCS_YCCK) {
+        jpeg_destroy_decompress(&info);
+        return (Image){0};
+    }
+
+    bool gray = info.num_components == 1;
+    info.out_color_space = gray ? JCS_GRAYSCALE : JCS_RGB;
+    info.scale_num = 1;
+    info.scale_denom = 1;
+    for (int denom = 8; denom > 1; denom /= 2) {
+        int scaled_w = (info.image_width + denom - 1) / denom;
+        int scaled_h = (info.image_height + denom - 1) / denom;
+        if (target_width > 0 && target_height > 0 && scaled_w >= target_width && scaled_h >= target_height) {
+            info.scale_denom = denom;
+            break;
+        }
+    }
+
+    jpeg_start_decompress(&info);
+    size_t stride = (size_t)info.output_width * info.output_components;
+    pixels = (unsigned char*)malloc(stride * info.output_height);
+
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW rows[4];
+        unsigned int count = 0;
+        for (; count < 4 && info.output_scanline + count < info.output_height; count++)
+            rows[count] = pixels + stride * (info.output_scanline + count);
+        jpeg_read_scanlines(&info, rows, count);
+    }
+
+    Image image = {
+        .data = pixels,
+        .width = (int)info.output_width,
+        .height = (int)info.output_height,
+        .mipmaps = 1,
+        .format = gray ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE : PIXELFORMAT_UNCOMPRESSED_R8G8B8,
+    };
+    jpeg_finish_decompress(&info);
+    jpeg_destroy_decompress(&info);
+    return image;
+}
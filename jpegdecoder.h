@@ -0,0 +1,26 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef JPEGDECODER_H
+#define JPEGDECODER_H
+
+#include <stddef.h>
+#include <raylib.h>
+
+/*
+ * JpegDecoder struct.
+ * JPEG decoding through libjpeg(-turbo), which can scale by 1/2, 1/4 or 1/8 in the DCT domain.
+ * Skipping the high frequency coefficients makes preview sized decodes several times faster
+ * than a full decode followed by a resize.
+ */
+struct JpegDecoder {
+public:
+    static Image decode(const unsigned char* data, size_t size, int target_width, int target_height, int* width, int* height);
+};
+
+#endif // JPEGDECODER_H
@@ -3,7 +3,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "ryi.h"
+#include "imageloader.h"
+#include "texturecache.h"
+#include "mappedfile.h"
+#include "dirscanner.h"
+#include "uring.h"
+#include "texturecodec.h"
+#include "framequeue.h"
+#include "uploadthread.h"
+#include "texturepool.h"
+#include "idle.h"
 #include "button.h"
 #include "popupmenu.h"
 
@@ -15,25 +26,69 @@ void print_usage() {
     printf("options:\n");
     printf("\t<dir>       \t- The directory to load images from (Optional)\n");
     printf("\t<url>       \t- The url to load images from (Optional)\n");
+    printf("\t-m <MB>     \t- Texture cache budget in megabytes (Default: 512)\n");
+    printf("\t-r          \t- Also load images from every directory below <dir>\n");
+    printf("\t-u          \t- Scan and read files with batched io_uring requests (Linux 5.6+)\n");
+    printf("\t-c <mode>   \t- Compress textures to none, bc1, bc3 or auto (bc3 for images with alpha) (Default: none)\n");
+    printf("\t-q <level>  \t- Compression quality, fast or high (Default: fast)\n");
+    printf("\t-p          \t- Keep 16 bit PNGs at full precision as half float textures (twice the VRAM of 8 bits)\n");
+    printf("\t-g          \t- Upload images from a background thread with its own GL context\n");
+    printf("\t-a          \t- Redraw every frame, even when nothing on screen changes\n");
+    printf("\t-b          \t- Benchmark loading <dir> with and without io_uring and texture compression, then exit\n");
     printf("\t-h          \t- Print this help infomation\n");
     printf("\n");
     printf("examples:\n");
     printf("\tryi           \t- Running the executable without any args in a folder with images will cause the it to read all images\n");
     printf("\tryi images    \t- Loads all images in dir\n");
+    printf("\tryi -r images \t- Loads all images in dir and its subdirectories\n");
     printf("\tryi https://* \t- Loads an image from the url\n");
 }
 
 int main(int argc, char *argv[]) {
 
-    char* flag = (char*)(argc - 1 == 0 ? "." : argv[argc - 1]);
+    char* flag = (char*)".";
+    bool benchmark = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-h") == 0) {
+            print_usage();
+            return 1;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            TextureCache::budget((size_t)atol(argv[++i]) * 1024 * 1024);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            DirScanner::recursive = true;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            Uring::enabled = Uring::supported();
+            if (!Uring::enabled)
+                printf("io_uring is not available on this kernel (needs 5.6+), using plain syscalls\n");
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            i++;
+            for (auto mode: {TextureCompression::NONE, TextureCompression::BC1, TextureCompression::BC3, TextureCompression::AUTO}) {
+                if (strcmp(argv[i], TextureCodec::name(mode)) == 0)
+                    TextureCodec::compression = mode;
+            }
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            TextureCodec::quality = strcmp(argv[++i], "high") == 0 ? CompressionQuality::HIGH : CompressionQuality::FAST;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            ImageLoader::high_precision = true;
+        } else if (strcmp(argv[i], "-g") == 0) {
+            UploadThread::enabled = true;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            Idle::enabled = false;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            benchmark = true;
+        } else {
+            flag = argv[i];
+        }
+    }
 
-    if (strcmp(flag, "-h") == 0) {
-        print_usage();
-        return 1;
+    if (benchmark) {
+        DirScanner::benchmark(flag);
+        TextureCodec::benchmark(flag);
+        return 0;
     }
 
     Ryi::init(flag);
-    auto images = Ryi::images();
+    auto& images = Ryi::images();
 
     auto goLeft = [&images]() {
         if (images.size() == 0) return;
@@ -80,20 +135,33 @@ int main(int argc, char *argv[]) {
     auto popupMenu = (new PopUpMenu)
         ->rect({0,0,20,0});
 
-    popupMenu->menu_item("Open Dir", [&images]() {
+    popupMenu->menu_item("Open Dir", []() {
         char* selected_path = tinyfd_selectFolderDialog("Open Images Folder", NULL);
         if (selected_path == nullptr)
             return;
 
-        if (images.size() > 0) {
-            for (auto& image: images) {
-                UnloadTexture(image.image);
-                free(image.path);
-            }
-        }
-        images.clear();
+        Ryi::unload_images();
         Ryi::load_images(selected_path);
-        images = Ryi::images();
+    });
+    popupMenu->menu_item("Toggle Follow Newest", []() {
+        Ryi::follow_newest = !Ryi::follow_newest;
+    });
+    popupMenu->separator();
+
+    popupMenu->menu_item("Sort by Name", []() {
+        Ryi::sort_images(SortMode::NAME);
+    });
+    popupMenu->menu_item("Sort by Date", []() {
+        Ryi::sort_images(SortMode::MTIME);
+    });
+    popupMenu->menu_item("Sort by Capture Time", []() {
+        Ryi::sort_images(SortMode::CAPTURE_TIME);
+    });
+    popupMenu->menu_item("Sort by Size", []() {
+        Ryi::sort_images(SortMode::SIZE);
+    });
+    popupMenu->menu_item("Sort by Dimensions", []() {
+        Ryi::sort_images(SortMode::DIMENSIONS);
     });
     popupMenu->separator();
 
@@ -168,7 +236,7 @@ int main(int argc, char *argv[]) {
     });
 
     while (Ryi::is_running) {
-        auto dt = GetFrameTime();
+        auto dt = Idle::enabled ? fminf(GetFrameTime(), IDLE_MAX_FRAME_TIME) : GetFrameTime();
         auto h = GetScreenHeight();
 
         if (!Ryi::grid_view) {
@@ -198,12 +266,27 @@ int main(int argc, char *argv[]) {
             okButton = okButton->size(30, 20) ;
             okButton->update();
         }
+        if (IsKeyPressed(KEY_F3))
+            Ryi::show_stats = !Ryi::show_stats;
+
         Ryi::debug.update(dt);
+        auto count = images.size();
+        Ryi::update();
+        // Queued uploads and frees change what is on screen, whatever ran this frame has to be drawn.
+        bool uploading = FrameQueue::pending() > 0;
+        FrameQueue::drain(FRAME_BUDGET);
         popupMenu->update();
 
         auto mouse_scroll = GetMouseWheelMove();
         Ryi::scale_factor += mouse_scroll * dt;
 
+        if (uploading || count != images.size() || Ryi::animating())
+            Idle::redraw();
+        // Nothing is in flight on a skipped frame, the pool can let go of its textures there as well.
+        if (!Idle::frame()) {
+            TexturePool::trim();
+            continue;
+        }
 
         BeginDrawing();
         {
@@ -224,14 +307,19 @@ int main(int argc, char *argv[]) {
             DrawText(TextFormat("%d/%d", Ryi::image_index + 1, images.size()), 5, 5, 13, BLACK);
             DrawText(TextFormat("%d/%d", Ryi::image_index + 1, images.size()), 6, 6, 13, RED);
             Ryi::debug.draw();
+            if (Ryi::show_stats)
+                Ryi::draw_stats();
         }
         EndDrawing();
+        // Pooled textures are only deleted here, once the frame that may have drawn them is done.
+        TexturePool::trim();
     }
 
-    for (auto& image: images) {
-        UnloadTexture(image.image);
-        free(image.path);
-    }
+    ImageLoader::stop();
+    Ryi::unload_images();
+    TexturePool::clear();
+    TraceLog(LOG_INFO, "RYI: Peak RSS %ld KB", MappedFile::peak_rss_kb());
+    TraceLog(LOG_INFO, "RYI: Drew %zu frames, skipped %zu, idle for %.1f s", Idle::drawn(), Idle::skipped(), Idle::idle_time());
 
     delete seekLeft;
     delete seekRight;
@@ -0,0 +1,169 @@
+#include "mappedfile.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "uring.h"
+
+// Chunk size and ring depth of io_uring reads, a whole file is several chunks in flight at once.
+const unsigned int READ_CHUNK = 1024 * 1024;
+const unsigned int READ_RING_ENTRIES = 16;
+
+std::mutex MappedFile::_mutex;
+std::unordered_set<std::string> MappedFile::_writing;
+
+bool MappedFile::open(const char* path) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if (Uring::enabled && read(fd, st.st_size)) {
+        ::close(fd);
+        return true;
+    }
+    if (MappedFile::is_writing(path)) {
+        bool copied = copy(fd, st.st_size);
+        ::close(fd);
+        return copied;
+    }
+
+    // The mapping keeps the file referenced, the descriptor is not needed past this point.
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    m_data = (unsigned char*)data;
+    m_size = st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data != nullptr && m_owned)
+        free(m_data);
+    else if (m_data != nullptr)
+        munmap(m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+    m_owned = false;
+}
+
+/*
+ * Reads the whole file into memory with up to READ_RING_ENTRIES chunked reads in flight. On network
+ * storage this keeps the link busy, where faulting a mapping in waits for one round trip per readahead
+ * window. Each loader thread has its own ring.
+ */
+bool MappedFile::read(int fd, size_t size) {
+    static thread_local Uring ring;
+    static thread_local bool tried = false;
+    if (!tried) {
+        tried = true;
+        ring.init(READ_RING_ENTRIES);
+    }
+    if (!ring.ready())
+        return false;
+
+    auto data = (unsigned char*)malloc(size);
+    if (data == NULL)
+        return false;
+
+    size_t chunks = (size + READ_CHUNK - 1) / READ_CHUNK;
+    int results[READ_RING_ENTRIES];
+    for (size_t first = 0; first < chunks; first += READ_RING_ENTRIES) {
+        unsigned int count = chunks - first < READ_RING_ENTRIES ? chunks - first : READ_RING_ENTRIES;
+        for (unsigned int i = 0; i < count; i++) {
+            size_t offset = (first + i) * READ_CHUNK;
+            unsigned int length = size - offset < READ_CHUNK ? size - offset : READ_CHUNK;
+            ring.read(fd, data + offset, length, offset, i);
+        }
+        if (!ring.wait_all(count, results)) {
+            // Reads may still be writing into `data`, it is leaked when they cannot be waited for.
+            if (ring.drain())
+                free(data);
+            return false;
+        }
+
+        // Short reads are rare (a file shrinking under us), finish those chunks with plain preads.
+        for (unsigned int i = 0; i < count; i++) {
+            size_t offset = (first + i) * READ_CHUNK;
+            size_t length = size - offset < READ_CHUNK ? size - offset : READ_CHUNK;
+            size_t done = results[i] > 0 ? results[i] : 0;
+            while (done < length) {
+                ssize_t got = pread(fd, data + offset + done, length - done, offset + done);
+                if (got <= 0) {
+                    free(data);
+                    return false;
+                }
+                done += got;
+            }
+        }
+    }
+
+    m_data = data;
+    m_size = size;
+    m_owned = true;
+    return true;
+}
+
+/*
+ * Reads the whole file into memory with plain reads. A file that shrinks while it is read fails
+ * to load, the DirWatcher reloads it once it is written.
+ */
+bool MappedFile::copy(int fd, size_t size) {
+    auto data = (unsigned char*)malloc(size);
+    if (data == NULL)
+        return false;
+
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(fd, data + done, size - done, done);
+        if (got <= 0) {
+            free(data);
+            return false;
+        }
+        done += got;
+    }
+
+    m_data = data;
+    m_size = size;
+    m_owned = true;
+    return true;
+}
+
+/*
+ * Marks a file as being written (IN_MODIFY) or done (IN_CLOSE_WRITE, deleted or moved away).
+ * Called from the DirWatcher on the render loop, `open` checks it on the loader threads.
+ */
+void MappedFile::set_writing(const char* path, bool writing) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (writing)
+        _writing.insert(path);
+    else
+        _writing.erase(path);
+}
+
+void MappedFile::clear_writing() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _writing.clear();
+}
+
+bool MappedFile::is_writing(const char* path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _writing.count(path) > 0;
+}
+
+long MappedFile::peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,51 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <stddef.h>
+#include <raylib.h>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/*
+ * MappedFile struct.
+ * A read only mmap of a whole file. Decoding straight from the mapping skips the malloc + copy
+ * raylib's LoadFileData does, which for big PNG scans is as much memory as the file itself.
+ * With the io_uring backend enabled the file is read into memory with batched reads instead.
+ * Files the DirWatcher saw being modified and not yet closed are read into memory too (`set_writing`),
+ * a mapping of a file its writer truncates raises SIGBUS on the next page the decoder touches.
+ */
+struct MappedFile {
+public:
+    bool open(const char* path);
+    void close();
+
+    const unsigned char* data() { return m_data; }
+    size_t size() { return m_size; }
+
+    static long peak_rss_kb();
+    static void set_writing(const char* path, bool writing);
+    static void clear_writing();
+
+private:
+    bool read(int fd, size_t size);
+    bool copy(int fd, size_t size);
+    static bool is_writing(const char* path);
+
+    static std::mutex _mutex;
+    static std::unordered_set<std::string> _writing;
+
+    unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_owned = false;
+};
+
+#endif // MAPPEDFILE_H
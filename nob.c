@@ -43,12 +43,38 @@ int main(int argc, char** argv) {
     nob_cmd_append(&cmd, "popupmenu.cpp");
     nob_cmd_append(&cmd, "renderimage.cpp");
     nob_cmd_append(&cmd, "ryi.cpp");
+    nob_cmd_append(&cmd, "imageloader.cpp");
+    nob_cmd_append(&cmd, "texturecache.cpp");
+    nob_cmd_append(&cmd, "prefetcher.cpp");
+    nob_cmd_append(&cmd, "thumbnailcache.cpp");
+    nob_cmd_append(&cmd, "mappedfile.cpp");
+    nob_cmd_append(&cmd, "imageprobe.cpp");
+    nob_cmd_append(&cmd, "jpegdecoder.cpp");
+    nob_cmd_append(&cmd, "progressivedecoder.cpp");
+    nob_cmd_append(&cmd, "dirscanner.cpp");
+    nob_cmd_append(&cmd, "uring.cpp");
+    nob_cmd_append(&cmd, "dirwatcher.cpp");
+    nob_cmd_append(&cmd, "fileformat.cpp");
+    nob_cmd_append(&cmd, "catalogsort.cpp");
+    nob_cmd_append(&cmd, "gifdecoder.cpp");
+    nob_cmd_append(&cmd, "animation.cpp");
+    nob_cmd_append(&cmd, "deepzoom.cpp");
+    nob_cmd_append(&cmd, "texturecodec.cpp");
+    nob_cmd_append(&cmd, "pixelbuffers.cpp");
+    nob_cmd_append(&cmd, "framequeue.cpp");
+    nob_cmd_append(&cmd, "uploadthread.cpp");
+    nob_cmd_append(&cmd, "texturepool.cpp");
+    nob_cmd_append(&cmd, "idle.cpp");
     nob_cmd_append(&cmd, "tinyfiledialogs.c");
     nob_cmd_append(&cmd, "-o");
     nob_cmd_append(&cmd, APP_NAME);
     nob_cmd_append(&cmd, "-lraylib");
     nob_cmd_append(&cmd, "-lraylib");
     nob_cmd_append(&cmd, "-lcurl");
+    nob_cmd_append(&cmd, "-ljpeg");
+    nob_cmd_append(&cmd, "-lpng");
+    nob_cmd_append(&cmd, "-lGL");
+    nob_cmd_append(&cmd, "-pthread");
 
 #if defined(__linux__) || defined(__unix__)
     nob_cmd_append(&cmd, "-lX11");
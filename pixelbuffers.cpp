@@ -0,0 +1,185 @@
+#include "pixelbuffers.h"
+#include "idle.h"
+#include <chrono>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <rlgl.h>
+#include "texturepool.h"
+#include "texturecodec.h"
+
+PixelBuffer PixelBuffers::_buffers[PIXEL_BUFFERS];
+std::mutex PixelBuffers::_mutex;
+std::condition_variable PixelBuffers::_cond;
+
+/*
+ * Called on a worker with the size of a prepared image. Waits for the render loop to map a free buffer
+ * of that size and returns its slot, or -1 when the image is too small, every buffer is taken or the
+ * render loop did not get to it in time.
+ */
+int PixelBuffers::acquire(size_t size) {
+    if (size < PIXEL_BUFFER_MIN_BYTES)
+        return -1;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    int slot = -1;
+    for (int i = 0; i < PIXEL_BUFFERS && slot < 0; i++) {
+        if (_buffers[i].state == PixelBufferState::FREE)
+            slot = i;
+    }
+    if (slot < 0)
+        return -1;
+
+    auto& buffer = _buffers[slot];
+    buffer.state = PixelBufferState::WANTED;
+    buffer.size = size;
+    // The render loop maps buffers in its update, which runs even on frames it does not draw.
+    Idle::wake();
+    bool answered = _cond.wait_for(lock, std::chrono::milliseconds(PIXEL_BUFFER_WAIT_MS), [&buffer]() {
+        return buffer.state != PixelBufferState::WANTED;
+    });
+    if (!answered) {
+        buffer.state = PixelBufferState::FREE;
+        return -1;
+    }
+    return buffer.state == PixelBufferState::MAPPED ? slot : -1;
+}
+
+/*
+ * Maps the buffers workers are waiting for. Called every frame from `ImageLoader::poll`.
+ * glBufferData with no data orphans the old storage, the GPU keeps reading it for uploads still in flight.
+ */
+void PixelBuffers::update() {
+    bool mapped = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& buffer: _buffers) {
+            if (buffer.state != PixelBufferState::WANTED)
+                continue;
+            if (buffer.id == 0)
+                glGenBuffers(1, &buffer.id);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer.size, NULL, GL_STREAM_DRAW);
+            buffer.data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, buffer.size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            buffer.state = buffer.data != NULL ? PixelBufferState::MAPPED : PixelBufferState::FREE;
+            mapped = true;
+        }
+    }
+    if (mapped)
+        _cond.notify_all();
+}
+
+/*
+ * Creates a texture with storage for every mip level, the way rlLoadTexture does for client memory:
+ * the same formats, the gray swizzles, repeat and nearest until the caller sets the filter, and
+ * GL_TEXTURE_MAX_LEVEL at the end of the chain. `pixels` holds the levels one after the other, NULL only
+ * allocates the storage. `buffered` textures read them from the bound pixel buffer instead.
+ */
+Texture2D PixelBuffers::create_texture(int width, int height, int format, int mipmaps, const unsigned char* pixels, bool buffered) {
+    unsigned int internal_format, pixel_format, type;
+    rlGetGlTextureFormats(format, &internal_format, &pixel_format, &type);
+    Texture2D texture = {.id = 0, .width = width, .height = height, .mipmaps = mipmaps, .format = format};
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &texture.id);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+
+    size_t offset = 0;
+    for (int level = 0; level < mipmaps; level++) {
+        size_t size = TextureCodec::level_bytes(width, height, format);
+        const void* data = buffered ? (const void*)offset : pixels != NULL ? pixels + offset : NULL;
+        if (format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, size, data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, pixel_format, type, data);
+        offset += size;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    if (format == PIXELFORMAT_UNCOMPRESSED_GRAYSCALE) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    } else if (format == PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA) {
+        GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipmaps - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+/*
+ * Writes `rows` rows of a mip level starting at row `y`. Block compressed levels are written in whole
+ * blocks, `y` and `rows` are multiples of 4 there (or reach the bottom of the level).
+ */
+void PixelBuffers::upload_rows(Texture2D texture, int level, int y, int rows, const unsigned char* pixels) {
+    unsigned int internal_format, pixel_format, type;
+    rlGetGlTextureFormats(texture.format, &internal_format, &pixel_format, &type);
+    int width = texture.width >> level > 1 ? texture.width >> level : 1;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    if (texture.format >= PIXELFORMAT_COMPRESSED_DXT1_RGB)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, rows, internal_format, TextureCodec::level_bytes(width, rows, texture.format), pixels);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, width, rows, pixel_format, type, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/*
+ * Creates the texture for the image a worker copied into `slot` (or reuses a pooled one), every level
+ * read from its offset in the buffer. The buffer is free again afterwards.
+ */
+Texture2D PixelBuffers::upload(int slot, int width, int height, int format, int mipmaps) {
+    auto& buffer = _buffers[slot];
+    auto texture = TexturePool::acquire(width, height, format, mipmaps);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    if (texture.id == 0) {
+        texture = PixelBuffers::create_texture(width, height, format, mipmaps, NULL, true);
+    } else {
+        size_t offset = 0;
+        for (int level = 0; level < mipmaps; level++) {
+            int level_height = height >> level > 1 ? height >> level : 1;
+            PixelBuffers::upload_rows(texture, level, 0, level_height, (const unsigned char*)offset);
+            offset += TextureCodec::level_bytes(width >> level > 1 ? width >> level : 1, level_height, format);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    buffer.data = NULL;
+    buffer.state = PixelBufferState::FREE;
+    return texture;
+}
+
+/*
+ * Gives back a buffer whose image was thrown away (a cancelled or outdated decode).
+ */
+void PixelBuffers::release(int slot) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto& buffer = _buffers[slot];
+    if (buffer.state != PixelBufferState::MAPPED)
+        return;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    buffer.data = NULL;
+    buffer.state = PixelBufferState::FREE;
+}
+
+/*
+ * Deletes the buffers. Called once the workers are stopped and every decoded image released.
+ */
+void PixelBuffers::unload() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& buffer: _buffers) {
+        if (buffer.id != 0)
+            glDeleteBuffers(1, &buffer.id);
+        buffer = {0};
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef PIXELBUFFERS_H
+#define PIXELBUFFERS_H
+
+#include <stddef.h>
+#include <raylib.h>
+#include <condition_variable>
+#include <mutex>
+
+const int PIXEL_BUFFERS = 3;
+// Smaller images go through raylib's regular upload, a round trip to the main thread would cost more than the copy.
+const size_t PIXEL_BUFFER_MIN_BYTES = 4ul * 1024 * 1024;
+// How long a worker waits for the render loop to map a buffer before it falls back to the regular upload.
+const int PIXEL_BUFFER_WAIT_MS = 250;
+
+enum class PixelBufferState {
+    FREE = 0,
+    WANTED,
+    MAPPED,
+};
+
+/*
+ * PixelBuffer struct.
+ * A pixel unpack buffer and the size a worker asked for. `data` is where it is mapped while MAPPED,
+ * from the worker filling it until the image is uploaded (or thrown away).
+ */
+struct PixelBuffer {
+    unsigned int id;
+    PixelBufferState state;
+    size_t size;
+    void* data;
+};
+
+/*
+ * PixelBuffers struct.
+ * Uploads large images through pixel buffer objects, so the render loop never copies their pixels.
+ * A worker that has decoded an image asks for a buffer of its size (`acquire`), the render loop
+ * orphans and maps one in `update` (the GPU may still be reading its old contents, orphaning hands
+ * back fresh storage instead of waiting), the worker copies the image and every mip level into it and
+ * `upload` only unmaps it and issues the texture calls, which read from the buffer asynchronously.
+ * Buffers are mapped per image, persistent mappings would need GL 4.4 and raylib asks for a 3.3 context.
+ * Also has the texture calls every large upload shares, `create_texture` and `upload_rows` for the strips
+ * the FrameQueue spreads unbuffered uploads over. GL calls happen on the main thread only.
+ */
+struct PixelBuffers {
+public:
+    static int acquire(size_t size);
+    static void* data(int slot) { return _buffers[slot].data; }
+    static void update();
+    static Texture2D upload(int slot, int width, int height, int format, int mipmaps);
+    static void release(int slot);
+    static Texture2D create_texture(int width, int height, int format, int mipmaps, const unsigned char* pixels, bool buffered = false);
+    static void upload_rows(Texture2D texture, int level, int y, int rows, const unsigned char* pixels);
+    static void unload();
+
+private:
+    static PixelBuffer _buffers[PIXEL_BUFFERS];
+    static std::mutex _mutex;
+    static std::condition_variable _cond;
+};
+
+#endif // PIXELBUFFERS_H
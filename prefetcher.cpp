@@ -0,0 +1,100 @@
+#include "prefetcher.h"
+#include <math.h>
+#include <algorithm>
+#include "ryi.h"
+#include "imageloader.h"
+#include "texturecache.h"
+
+const int PREFETCH_MAX_AHEAD = 8;
+const double PREFETCH_SMOOTHING = 0.3;
+
+std::vector<unsigned int> Prefetcher::_window;
+int Prefetcher::_last_index = -1;
+int Prefetcher::_direction = 1;
+int Prefetcher::_ahead = 2;
+double Prefetcher::_last_change = 0;
+double Prefetcher::_decode_time = 0.05;
+double Prefetcher::_dwell_time = 1.0;
+
+/*
+ * Called once per frame in slide view. Tracks direction and dwell time whenever the index changes,
+ * then makes sure every entry in the window is loaded, nearest first.
+ */
+void Prefetcher::update(int index, int count) {
+    if (index < 0 || count <= 0)
+        return;
+
+    double now = GetTime();
+    if (index != _last_index) {
+        if (_last_index >= 0) {
+            int step = index - _last_index;
+            if (step > count / 2) step -= count;
+            if (step < -count / 2) step += count;
+            if (step != 0) _direction = step > 0 ? 1 : -1;
+
+            double dwell = now - _last_change;
+            _dwell_time += (dwell - _dwell_time) * PREFETCH_SMOOTHING;
+        }
+        _last_index = index;
+        _last_change = now;
+        Prefetcher::adapt();
+    }
+
+    std::vector<unsigned int> window;
+    auto& images = Ryi::images();
+    auto rect = Ryi::get_dest_rect(Ryi::image_mode, Ryi::scale_factor);
+    int behind = std::min(1, count - 1);
+    int ahead = std::min(_ahead, count - 1 - behind);
+
+    // Priority order is the next image, the ones after it, then the one behind.
+    // Urgent requests go to the front of the loader queue, so push in reverse.
+    std::vector<int> offsets;
+    for (int i = 1; i <= ahead; i++) offsets.push_back(i);
+    for (int i = 1; i <= behind; i++) offsets.push_back(-i);
+
+    for (auto it = offsets.rbegin(); it != offsets.rend(); ++it) {
+        int slot = ((index + *it * _direction) % count + count) % count;
+        auto& image = images[slot];
+        image.prefetch(true, rect.width, rect.height);
+        window.push_back(image.id);
+    }
+
+    // Whatever fell out of the window and has not started decoding yet is no longer worth it.
+    for (auto id: _window) {
+        if (std::find(window.begin(), window.end(), id) != window.end())
+            continue;
+        auto image = Ryi::find_image(id);
+        if (image != NULL && image->state == TextureState::LOADING && ImageLoader::withdraw(id, TextureKind::FULL))
+            image->state = TextureState::EMPTY;
+    }
+    _window = window;
+}
+
+void Prefetcher::record_decode(double seconds) {
+    _decode_time += (seconds - _decode_time) * PREFETCH_SMOOTHING;
+}
+
+void Prefetcher::reset() {
+    _window.clear();
+    _last_index = -1;
+    _direction = 1;
+}
+
+/*
+ * The user moves on every `dwell_time` seconds, so by the time one decode finishes they are
+ * decode/dwell images further along. Keep that many (plus one) ready, capped by what the
+ * texture budget can hold next to the image on screen.
+ */
+void Prefetcher::adapt() {
+    int ahead = (int)ceil(_decode_time / std::max(_dwell_time, 0.001)) + 1;
+
+    if (TextureCache::count() > 0) {
+        size_t average = TextureCache::used() / TextureCache::count();
+        if (average > 0) {
+            int fits = (int)(TextureCache::budget() / 2 / average) - 2;
+            ahead = std::min(ahead, fits);
+        }
+    }
+
+    _ahead = std::clamp(ahead, 1, PREFETCH_MAX_AHEAD);
+}
@@ -0,0 +1,44 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <vector>
+
+/*
+ * Prefetcher struct.
+ * Keeps a window of catalog entries around Ryi::image_index decoded and uploaded, so goLeft/goRight
+ * land on a texture that is already on the GPU. The window leans in the direction the user is moving
+ * and its depth follows how long a decode takes compared to how long the user looks at each image:
+ * scrubbing quickly through slow to decode files widens the window, slow browsing keeps it narrow.
+ */
+struct Prefetcher {
+public:
+    static void update(int index, int count);
+    static void record_decode(double seconds);
+    static void reset();
+
+    static int ahead() { return _ahead; }
+    static int direction() { return _direction; }
+    static double decode_time() { return _decode_time; }
+    static double dwell_time() { return _dwell_time; }
+
+private:
+    static void adapt();
+
+    static std::vector<unsigned int> _window;
+    static int _last_index;
+    static int _direction;
+    static int _ahead;
+    static double _last_change;
+    static double _decode_time;
+    static double _dwell_time;
+};
+
+#endif // PREFETCHER_H
@@ -0,0 +1,389 @@
+#include "progressivedecoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <chrono>
+#include <algorithm>
+#include <jpeglib.h>
+#include <png.h>
+
+// Intermediate passes are published at most this often, every pass costs a full IDCT / copy.
+const double PROGRESSIVE_PUBLISH_INTERVAL = 0.05;
+// Rows of the image an Adam7 row stands for until later passes fill in the rows below it.
+const int PNG_PASS_ROWS[7] = {8, 8, 4, 4, 2, 2, 1};
+
+/*
+ * libjpeg state of a ProgressiveDecoder. The source manager never blocks: it hands libjpeg whatever
+ * bytes have arrived so far and suspends when they run out, `feed` resumes it.
+ */
+struct ProgressiveJpeg {
+    jpeg_decompress_struct info;
+    jpeg_error_mgr error;
+    jpeg_source_mgr source;
+    jmp_buf jump;
+    ProgressiveDecoder* decoder;
+
+    static void error_exit(j_common_ptr info) {
+        longjmp(((ProgressiveJpeg*)info->client_data)->jump, 1);
+    }
+
+    static void output_message(j_common_ptr) {
+    }
+
+    static void init_source(j_decompress_ptr) {
+    }
+
+    static boolean fill_input_buffer(j_decompress_ptr info) {
+        auto jpeg = (ProgressiveJpeg*)info->client_data;
+        if (!jpeg->decoder->m_complete)
+            return FALSE;
+
+        // Out of data for good: a fake EOI lets libjpeg finish a truncated file with what it has.
+        static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+        jpeg->source.next_input_byte = eoi;
+        jpeg->source.bytes_in_buffer = 2;
+        return TRUE;
+    }
+
+    static void skip_input_data(j_decompress_ptr info, long count) {
+        auto jpeg = (ProgressiveJpeg*)info->client_data;
+        if (count <= 0)
+            return;
+        if ((size_t)count > jpeg->source.bytes_in_buffer) {
+            jpeg->decoder->m_skip += count - jpeg->source.bytes_in_buffer;
+            count = jpeg->source.bytes_in_buffer;
+        }
+        jpeg->source.next_input_byte += count;
+        jpeg->source.bytes_in_buffer -= count;
+    }
+
+    static void term_source(j_decompress_ptr) {
+    }
+};
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void png_warning_silent(png_structp, png_const_charp) {
+}
+
+ProgressiveDecoder::ProgressiveDecoder(int target_width, int target_height, PassHandler on_pass):
+    m_target_width(target_width), m_target_height(target_height), m_on_pass(on_pass) {}
+
+ProgressiveDecoder::~ProgressiveDecoder() {
+    if (m_jpeg != nullptr) {
+        jpeg_destroy_decompress(&m_jpeg->info);
+        delete m_jpeg;
+    }
+    if (m_png != nullptr)
+        png_destroy_read_struct(&m_png, &m_png_info, NULL);
+    UnloadImage(m_image);
+}
+
+/*
+ * Appends bytes that just arrived and decodes as far as they allow.
+ * Returns false once the data turned out to be broken.
+ */
+bool ProgressiveDecoder::feed(const unsigned char* data, size_t size) {
+    size_t jpeg_offset = 0;
+    if (m_jpeg != nullptr && m_jpeg->source.next_input_byte != NULL)
+        jpeg_offset = m_jpeg->source.next_input_byte - m_data;
+
+    m_buffer.insert(m_buffer.end(), data, data + size);
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    if (m_failed || m_final)
+        return !m_failed;
+
+    if (m_jpeg != nullptr) {
+        size_t skip = m_skip < m_size - jpeg_offset ? m_skip : m_size - jpeg_offset;
+        m_skip -= skip;
+        jpeg_offset += skip;
+        m_jpeg->source.next_input_byte = m_data + jpeg_offset;
+        m_jpeg->source.bytes_in_buffer = m_size - jpeg_offset;
+        return run_jpeg();
+    }
+
+    if (m_png != nullptr)
+        return run_png(data, size);
+
+    if (m_format == FileFormat::UNKNOWN && m_size >= FileFormats::MAGIC_SIZE) {
+        m_format = FileFormats::from_magic(m_data, m_size);
+        if (m_format == FileFormat::PNG || m_format == FileFormat::JPEG)
+            return run();
+    }
+    return true;
+}
+
+/*
+ * Decodes a buffer that is complete already (a memory mapped file). Passes are still published
+ * as they finish, the buffer is used in place and must outlive the decoder.
+ */
+bool ProgressiveDecoder::decode(const unsigned char* data, size_t size) {
+    m_data = data;
+    m_size = size;
+    m_complete = true;
+    m_format = FileFormats::from_magic(data, size);
+    return run();
+}
+
+/*
+ * Ends the input and returns the final image, owned by the caller. Truncated JPEGs and PNGs return
+ * whatever was decoded, data our decoders refused goes through raylib as a last resort.
+ */
+Image ProgressiveDecoder::finish(int* width, int* height) {
+    m_complete = true;
+    if (m_jpeg != nullptr && !m_final && !m_failed)
+        run_jpeg();
+
+    Image image = {0};
+    bool usable = m_final || (m_png != nullptr && m_image.data != NULL);
+    if (usable && !m_failed) {
+        image = m_image;
+        m_image = (Image){0};
+    } else if (m_size > 0) {
+        const char* extension = FileFormats::extension(FileFormats::from_magic(m_data, m_size));
+        if (extension != NULL)
+            image = LoadImageFromMemory(extension, m_data, (int)m_size);
+    }
+
+    *width = m_width > 0 ? m_width : image.width;
+    *height = m_height > 0 ? m_height : image.height;
+    return image;
+}
+
+bool ProgressiveDecoder::is_progressive(FileFormat format, const unsigned char* data, size_t size) {
+    if (format == FileFormat::PNG)
+        return size > 28 && memcmp(data + 12, "IHDR", 4) == 0 && data[28] == 1;
+
+    if (format != FileFormat::JPEG || size < 4)
+        return false;
+
+    size_t offset = 2;
+    while (offset + 4 <= size && data[offset] == 0xFF) {
+        int marker = data[offset + 1];
+        if (marker == 0xFF) {
+            offset++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            offset += 2;
+            continue;
+        }
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            return marker == 0xC2 || marker == 0xC6 || marker == 0xCA || marker == 0xCE;
+        if (marker == 0xDA || marker == 0xD9)
+            return false;
+        offset += 2 + ((data[offset + 2] << 8) | data[offset + 3]);
+    }
+    return false;
+}
+
+bool ProgressiveDecoder::run() {
+    if (m_format == FileFormat::JPEG) {
+        m_jpeg = new ProgressiveJpeg();
+        m_jpeg->decoder = this;
+        m_jpeg->info.err = jpeg_std_error(&m_jpeg->error);
+        m_jpeg->error.error_exit = ProgressiveJpeg::error_exit;
+        m_jpeg->error.output_message = ProgressiveJpeg::output_message;
+        jpeg_create_decompress(&m_jpeg->info);
+        m_jpeg->info.client_data = m_jpeg;
+        m_jpeg->info.src = &m_jpeg->source;
+        m_jpeg->source.init_source = ProgressiveJpeg::init_source;
+        m_jpeg->source.fill_input_buffer = ProgressiveJpeg::fill_input_buffer;
+        m_jpeg->source.skip_input_data = ProgressiveJpeg::skip_input_data;
+        m_jpeg->source.resync_to_restart = jpeg_resync_to_restart;
+        m_jpeg->source.term_source = ProgressiveJpeg::term_source;
+        m_jpeg->source.next_input_byte = m_data;
+        m_jpeg->source.bytes_in_buffer = m_size;
+        return run_jpeg();
+    }
+
+    if (m_format == FileFormat::PNG) {
+        m_png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, png_warning_silent);
+        m_png_info = png_create_info_struct(m_png);
+        png_set_progressive_read_fn(m_png, this, ProgressiveDecoder::png_info, ProgressiveDecoder::png_row, ProgressiveDecoder::png_end);
+        return run_png(m_data, m_size);
+    }
+    return true;
+}
+
+/*
+ * libjpeg buffered-image mode: consume input scan by scan, and after a completed scan run an output
+ * pass over the coefficients gathered so far. Every call picks up where the last one suspended.
+ */
+bool ProgressiveDecoder::run_jpeg() {
+    auto& info = m_jpeg->info;
+    if (setjmp(m_jpeg->jump)) {
+        m_failed = true;
+        return false;
+    }
+
+    if (m_jpeg_stage == 0) {
+        if (jpeg_read_header(&info, TRUE) == JPEG_SUSPENDED)
+            return true;
+
+        m_width = info.image_width;
+        m_height = info.image_height;
+        if (info.jpeg_color_space == JCS_CMYK || info.jpeg_color_space == JCS_YCCK) {
+            m_failed = true;
+            return false;
+        }
+
+        info.out_color_space = info.num_components == 1 ? JCS_GRAYSCALE : JCS_RGB;
+        info.buffered_image = TRUE;
+        info.scale_num = 1;
+        info.scale_denom = 1;
+        for (int denom = 8; denom > 1; denom /= 2) {
+            int scaled_w = (m_width + denom - 1) / denom;
+            int scaled_h = (m_height + denom - 1) / denom;
+            if (m_target_width > 0 && m_target_height > 0 && scaled_w >= m_target_width && scaled_h >= m_target_height) {
+                info.scale_denom = denom;
+                break;
+            }
+        }
+        m_jpeg_stage = 1;
+    }
+
+    if (m_jpeg_stage == 1) {
+        if (!jpeg_start_decompress(&info))
+            return true;
+
+        m_image.width = info.output_width;
+        m_image.height = info.output_height;
+        m_image.mipmaps = 1;
+        m_image.format = info.output_components == 1 ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE : PIXELFORMAT_UNCOMPRESSED_R8G8B8;
+        m_image.data = calloc((size_t)info.output_width * info.output_components, info.output_height);
+        m_jpeg_stage = 2;
+    }
+
+    if (m_jpeg_stage == 2) {
+        if (m_output_open) {
+            if (!jpeg_finish_output(&info))
+                return true;
+            m_output_open = false;
+        }
+
+        while (true) {
+            int result = jpeg_consume_input(&info);
+            if (result == JPEG_SUSPENDED)
+                break;
+            if (result == JPEG_REACHED_EOI) {
+                m_jpeg_stage = 3;
+                break;
+            }
+            if (result == JPEG_SCAN_COMPLETED && m_on_pass && now() - m_last_publish >= PROGRESSIVE_PUBLISH_INTERVAL) {
+                if (!output_jpeg(info.input_scan_number))
+                    return true;
+                publish(false);
+            }
+        }
+    }
+
+    if (m_jpeg_stage == 3) {
+        if (!output_jpeg(info.input_scan_number))
+            return true;
+        jpeg_finish_decompress(&info);
+        m_jpeg_stage = 4;
+        m_final = true;
+    }
+    return true;
+}
+
+/*
+ * One output pass at the quality of `scan`. Returns false when libjpeg suspended half way,
+ * the pass is closed on the next run then.
+ */
+bool ProgressiveDecoder::output_jpeg(int scan) {
+    auto& info = m_jpeg->info;
+    if (!jpeg_start_output(&info, scan))
+        return false;
+
+    m_output_open = true;
+    size_t stride = (size_t)info.output_width * info.output_components;
+    while (info.output_scanline < info.output_height) {
+        JSAMPROW row = (JSAMPROW)m_image.data + stride * info.output_scanline;
+        if (jpeg_read_scanlines(&info, &row, 1) == 0)
+            return false;
+    }
+
+    if (!jpeg_finish_output(&info))
+        return false;
+    m_output_open = false;
+    return true;
+}
+
+bool ProgressiveDecoder::run_png(const unsigned char* data, size_t size) {
+    if (setjmp(png_jmpbuf(m_png))) {
+        m_failed = true;
+        return false;
+    }
+    png_process_data(m_png, m_png_info, (png_bytep)data, size);
+    return true;
+}
+
+void ProgressiveDecoder::png_info(png_struct_def* png, png_info_def* info) {
+    auto self = (ProgressiveDecoder*)png_get_progressive_ptr(png);
+    png_uint_32 width, height;
+    int bit_depth, color_type, interlace;
+    png_get_IHDR(png, info, &width, &height, &bit_depth, &color_type, &interlace, NULL, NULL);
+
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    int channels = png_get_channels(png, info);
+    self->m_width = width;
+    self->m_height = height;
+    self->m_interlaced = interlace != PNG_INTERLACE_NONE;
+    self->m_png_stride = png_get_rowbytes(png, info);
+    self->m_image.width = width;
+    self->m_image.height = height;
+    self->m_image.mipmaps = 1;
+    self->m_image.format =
+        channels == 1 ? PIXELFORMAT_UNCOMPRESSED_GRAYSCALE :
+        channels == 2 ? PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA :
+        channels == 3 ? PIXELFORMAT_UNCOMPRESSED_R8G8B8 : PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    self->m_image.data = calloc(self->m_png_stride, height);
+}
+
+/*
+ * libpng widens interlaced rows to full width when they are combined. Rows outside the current pass
+ * come with `row` NULL, whether early rows are repeated down their block depends on how libpng was built,
+ * so each row of the pass is copied down over the rows below it that no pass has reached yet. Every
+ * published pass is a blocky but complete preview instead of stripes over black, later passes write
+ * those rows whole the first time they reach them.
+ */
+void ProgressiveDecoder::png_row(png_struct_def* png, unsigned char* row, unsigned int row_number, int pass) {
+    auto self = (ProgressiveDecoder*)png_get_progressive_ptr(png);
+    if (pass != self->m_png_pass) {
+        if (self->m_interlaced && self->m_on_pass && now() - self->m_last_publish >= PROGRESSIVE_PUBLISH_INTERVAL)
+            self->publish(false);
+        self->m_png_pass = pass;
+    }
+
+    if (row == NULL || row_number >= (unsigned int)self->m_image.height)
+        return;
+
+    auto target = (png_bytep)self->m_image.data + self->m_png_stride * row_number;
+    png_progressive_combine_row(png, target, row);
+    if (!self->m_interlaced || !PNG_ROW_IN_INTERLACE_PASS(row_number, pass))
+        return;
+    int below = std::min<int>(PNG_PASS_ROWS[pass], self->m_image.height - row_number);
+    for (int copy = 1; copy < below; copy++)
+        memcpy(target + self->m_png_stride * copy, target, self->m_png_stride);
+}
+
+void ProgressiveDecoder::png_end(png_struct_def* png, png_info_def*) {
+    auto self = (ProgressiveDecoder*)png_get_progressive_ptr(png);
+    self->m_final = true;
+}
+
+void ProgressiveDecoder::publish(bool final) {
+    m_last_publish = now();
+    if (!final && m_on_pass)
+        m_on_pass(m_image);
+}
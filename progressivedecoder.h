@@ -0,0 +1,90 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef PROGRESSIVEDECODER_H
+#define PROGRESSIVEDECODER_H
+
+#include <stddef.h>
+#include <raylib.h>
+#include <functional>
+#include <vector>
+#include "fileformat.h"
+
+struct jpeg_decompress_struct;
+struct png_struct_def;
+struct png_info_def;
+struct ProgressiveJpeg;
+
+/*
+ * PassHandler Event handler.
+ * Gets called with every intermediate pass of a progressive decode. The Image is only borrowed,
+ * copy it to keep it.
+ */
+using PassHandler = std::function<void(Image)>;
+
+/*
+ * ProgressiveDecoder struct.
+ * A push decoder: bytes go in through `feed` as they arrive (from disk or from the network) and every
+ * finished scan of a progressive JPEG or pass of an Adam7 interlaced PNG comes out through the
+ * PassHandler, so something coarse can be drawn long before the whole file is there.
+ * Baseline JPEGs and plain PNGs simply produce their final image, other formats are buffered and
+ * handed to raylib once `finish` is called.
+ */
+struct ProgressiveDecoder {
+public:
+    ProgressiveDecoder(int target_width, int target_height, PassHandler on_pass);
+    ~ProgressiveDecoder();
+
+    bool feed(const unsigned char* data, size_t size);
+    bool decode(const unsigned char* data, size_t size);
+    Image finish(int* width, int* height);
+
+    static bool is_progressive(FileFormat format, const unsigned char* data, size_t size);
+
+private:
+    friend struct ProgressiveJpeg;
+
+    bool run();
+    bool run_jpeg();
+    bool run_png(const unsigned char* data, size_t size);
+    bool output_jpeg(int scan);
+    void publish(bool final);
+
+    static void png_info(png_struct_def*, png_info_def*);
+    static void png_row(png_struct_def*, unsigned char*, unsigned int, int);
+    static void png_end(png_struct_def*, png_info_def*);
+
+    FileFormat m_format = FileFormat::UNKNOWN;
+    std::vector<unsigned char> m_buffer;
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_skip = 0;
+    bool m_complete = false;
+    bool m_failed = false;
+
+    ProgressiveJpeg* m_jpeg = nullptr;
+    int m_jpeg_stage = 0;
+    bool m_output_open = false;
+
+    png_struct_def* m_png = nullptr;
+    png_info_def* m_png_info = nullptr;
+    int m_png_pass = 0;
+    size_t m_png_stride = 0;
+    bool m_interlaced = false;
+
+    int m_target_width;
+    int m_target_height;
+    int m_width = 0;
+    int m_height = 0;
+    Image m_image = {0};
+    bool m_final = false;
+    double m_last_publish = 0;
+    PassHandler m_on_pass;
+};
+
+#endif // PROGRESSIVEDECODER_H
@@ -2,29 +2,111 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
 #include "ryi.h"
+#include "imageloader.h"
+#include "texturecache.h"
+#include "deepzoom.h"
+#include "texturepool.h"
 
 
-std::vector<RenderImage> RenderImage::load_images_from_dir(const char* path){
-    std::vector<RenderImage> images;
-    DIR* dir = opendir(path);
-    if (dir == NULL)
-        return images;
-    dirent* next_dir = readdir(dir);;
-    while (next_dir != NULL) {
-        char* file_name = next_dir->d_name;
-        char* extension = strchr(file_name, '.');
-        bool isValid = Ryi::is_image_supported(extension);
-        if (next_dir->d_type == DT_REG && extension != NULL && isValid) {
-            const char* image_path = TextFormat("%s/%s", path, file_name);
-            auto image = LoadTexture(image_path);
-            SetTextureFilter(image, TEXTURE_FILTER_ANISOTROPIC_16X);
-            images.push_back((RenderImage){.path = strdup(image_path), .image = image});
+/*
+ * The file to decode. Same as `path`, except for images loaded from a url, which are decoded
+ * from their downloaded copy.
+ */
+const char* RenderImage::source() {
+    return Ryi::is_url(path) ? Ryi::download_path : path;
+}
+
+bool RenderImage::tiled() {
+    return DeepZoom::wants(width, height);
+}
+
+/*
+ * Returns true when the texture is ready to be drawn, otherwise queues a decode (once)
+ * and returns false. Urgent requests skip ahead of everything else in the loader queue.
+ * `width` x `height` is the size the image is drawn at, the decoder may stop at any size that
+ * covers it. When a texture that was decoded smaller no longer covers it (zooming in, a bigger
+ * window) a larger decode is queued and the small texture keeps being drawn meanwhile.
+ */
+bool RenderImage::request(bool urgent, float width, float height) {
+    if (state == TextureState::READY) {
+        TextureCache::touch(id, TextureKind::FULL);
+        bool reduced = image.width < this->width || image.height < this->height;
+        if (reduced && !refining && (image.width < width || image.height < height)) {
+            refining = true;
+            ImageLoader::request(*this, TextureKind::FULL, urgent, width, height);
         }
-        next_dir = readdir(dir);;
+        return true;
+    }
+
+    if (state == TextureState::EMPTY) {
+        TextureCache::miss();
+        state = TextureState::LOADING;
+        ImageLoader::request(*this, TextureKind::FULL, urgent, width, height);
     }
+    return false;
+}
 
+/*
+ * Same as `request` but for images that are not on screen yet, so it does not count towards
+ * the cache hit/miss counters. Keeps an already loaded texture from being evicted.
+ */
+void RenderImage::prefetch(bool urgent, float width, float height) {
+    if (tiled())
+        return;
+    if (state == TextureState::READY) {
+        TextureCache::keep(id, TextureKind::FULL);
+    } else if (state == TextureState::EMPTY) {
+        state = TextureState::LOADING;
+        ImageLoader::request(*this, TextureKind::FULL, urgent, width, height);
+    }
+}
 
-    return images;
+/*
+ * Returns the smallest thumbnail level that still covers a `width` x `height` rectangle on screen
+ * (or the largest one there is), or NULL while the pyramid is still being built.
+ */
+Texture2D* RenderImage::request_thumbnail(float width, float height, bool urgent) {
+    if (thumbnail_state == TextureState::READY) {
+        TextureCache::touch(id, TextureKind::THUMBNAIL);
+        float needed = width > height ? width : height;
+        for (int level = 0; level < THUMBNAIL_LEVELS - 1; level++) {
+            if (THUMBNAIL_SIZES[level] >= needed)
+                return &thumbnails[level];
+        }
+        return &thumbnails[THUMBNAIL_LEVELS - 1];
+    }
+
+    if (thumbnail_state == TextureState::EMPTY) {
+        TextureCache::miss();
+        thumbnail_state = TextureState::LOADING;
+        ImageLoader::request(*this, TextureKind::THUMBNAIL, urgent);
+    }
+    return NULL;
+}
+
+void RenderImage::unload() {
+    unload(TextureKind::FULL);
+    unload(TextureKind::THUMBNAIL);
+}
+
+/*
+ * Gives the texture to the TexturePool, the next image of its size is written into it.
+ */
+void RenderImage::unload(TextureKind kind) {
+    TextureCache::remove(id, kind);
+    if (kind == TextureKind::FULL) {
+        if (state == TextureState::READY)
+            TexturePool::release(image);
+        image = {0};
+        state = TextureState::EMPTY;
+        refining = false;
+    } else {
+        for (int level = 0; level < THUMBNAIL_LEVELS; level++) {
+            if (thumbnail_state == TextureState::READY)
+                TexturePool::release(thumbnails[level]);
+            thumbnails[level] = {0};
+        }
+        thumbnail_state = TextureState::EMPTY;
+    }
 }
@@ -10,19 +10,76 @@
 #define RENDERIMAGE_H
 
 #include <vector>
+#include <time.h>
 #include <raylib.h>
+#include "fileformat.h"
+
+/*
+ * TextureState enum.
+ * Where the texture of a catalog entry is in its lifetime.
+ */
+enum class TextureState {
+    EMPTY = 0,
+    LOADING,
+    READY,
+    FAILED,
+};
+
+/*
+ * TextureKind enum.
+ * The textures a catalog entry can have loaded: the full resolution image for slide view,
+ * and the thumbnail pyramid for the grid.
+ */
+enum class TextureKind {
+    FULL = 0,
+    THUMBNAIL,
+};
+
+/*
+ * Thumbnail pyramid levels. Each level fits the image inside a box of that many pixels.
+ */
+const int THUMBNAIL_LEVELS = 4;
+const int THUMBNAIL_SIZES[THUMBNAIL_LEVELS] = {64, 128, 256, 512};
 
 /*
  * RenderImage Context struct.
- * Contains a Raylib Texture2D and the path it was loaded from.
- * Useful for displaying information about images at runtime.
- * If more info needs to be shared, this is the struct to modify
+ * A catalog entry: the path of an image plus the metadata that is cheap to get from the file system.
+ * The Raylib Texture2D is only loaded when something asks for it through `request`, so scanning a
+ * directory costs one stat per file instead of a full decode and upload.
+ * The grid never touches the full texture, it draws from a small thumbnail pyramid built off-thread.
+ * The full texture itself may be decoded at a reduced size when that still covers the screen,
+ * `refining` is set while a larger version is on its way. Images too large for one texture are `tiled`,
+ * they never get a full texture and are drawn by DeepZoom instead. `sort_key` is the natural order key of the path,
+ * built once when the entry is found. `version` counts the rewrites of the file the DirWatcher saw, decodes of
+ * an older version are thrown away instead of uploaded.
+ * If more info needs to be shared, this is the struct to modify.
  */
 struct RenderImage {
+    unsigned int id;
     char* path;
+    long file_size;
+    time_t mtime;
+    FileFormat format;
+    int width;
+    int height;
+    int channels;
+    int bit_depth;
+    time_t capture_time;
+    char* sort_key;
+    unsigned int version;
     Texture2D image;
+    TextureState state;
+    Texture2D thumbnails[THUMBNAIL_LEVELS];
+    TextureState thumbnail_state;
+    bool refining;
 
-    static std::vector<RenderImage> load_images_from_dir(const char*);
+    const char* source();
+    bool tiled();
+    bool request(bool urgent = false, float width = 0, float height = 0);
+    void prefetch(bool urgent = false, float width = 0, float height = 0);
+    Texture2D* request_thumbnail(float width, float height, bool urgent = false);
+    void unload();
+    void unload(TextureKind);
 };
 
 #endif // RENDERIMAGE_H
@@ -2,9 +2,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
+#include <math.h>
 
 #include "ryi.h"
+#include "imageloader.h"
+#include "texturecache.h"
+#include "prefetcher.h"
+#include "mappedfile.h"
+#include "dirscanner.h"
+#include "dirwatcher.h"
+#include "catalogsort.h"
+#include "animation.h"
+#include "deepzoom.h"
+#include "texturecodec.h"
+#include "framequeue.h"
+#include "uploadthread.h"
+#include "texturepool.h"
+#include "idle.h"
+#include "uring.h"
 
 #include "build.h"
 #include "license.h"
@@ -16,16 +31,23 @@ bool Ryi::grid_view = false;
 int Ryi::scroll_y = 700;
 bool Ryi::is_running = true;
 bool Ryi::show_about = false;
+bool Ryi::show_stats = false;
+bool Ryi::follow_newest = false;
+SortMode Ryi::sort_mode = SortMode::NAME;
+double Ryi::sort_time = 0;
 float Ryi::scale_factor = 1;
 float Ryi::rotation = 0;
 ErrorView Ryi::debug(3.0f);
 ImageMode Ryi::image_mode = ImageMode::SCALE;
 Rectangle Ryi::dialog_rect = {0, 0, 0, 0};
+const char* Ryi::download_path = "/tmp/imag.png";
 
 void Ryi::init(char* path) {
     InitWindow(600, 400, "Ryi");
     SetTargetFPS(60);
     SetWindowState(FLAG_WINDOW_RESIZABLE);
+    ImageLoader::start();
+    UploadThread::start();
 
     if (Ryi::is_url(path))
         Ryi::load_from_url(path);
@@ -33,6 +55,49 @@ void Ryi::init(char* path) {
         Ryi::load_images(path);
 }
 
+/*
+ * Per frame work that is not drawing. Adds what the directory scan found so far and queues the uploads
+ * of images the loader finished decoding, the FrameQueue spreads them over frames so a big directory
+ * never stalls the render loop.
+ */
+void Ryi::update() {
+    bool scanned = DirScanner::poll(8192);
+    if (scanned && !Ryi::_images.empty())
+        Ryi::sort_images(Ryi::sort_mode);
+    if (scanned && Ryi::_images.empty()) {
+        const char* path = DirScanner::root();
+        if (path != NULL && *path == '.')
+            Ryi::debug.report("Failed to load images from current directory (`.`)");
+        else
+            Ryi::debug.report(TextFormat("Failed to load images from path: `%s`", path));
+    }
+    // Events wait in the kernel queue until the scan is done, so nothing is added twice.
+    if (!DirScanner::scanning())
+        DirWatcher::poll();
+    TextureCache::begin_frame();
+    if (!Ryi::grid_view)
+        Prefetcher::update(Ryi::image_index, Ryi::_images.size());
+    ImageLoader::poll();
+    auto shown = Ryi::grid_view || Ryi::image_index < 0 || Ryi::image_index >= (int)Ryi::_images.size() ? NULL : &Ryi::_images[Ryi::image_index];
+    Animation::update(shown);
+    DeepZoom::update(shown);
+}
+
+/*
+ * Whether the screen changes on its own this frame, without input: a GIF playing, a deep zoom image
+ * still being tiled (or with tiles left to upload), the directory scan adding entries, textures from
+ * the UploadThread waiting on their fences, the about dialog scrolling or an error fading out.
+ * The render loop keeps drawing while it is.
+ */
+bool Ryi::animating() {
+    if (Animation::has_frames() || DirScanner::scanning() || UploadThread::finished() > 0)
+        return true;
+    // A failed image never gets tiles, one that is done only until the last of them are uploaded.
+    if (DeepZoom::active() && !DeepZoom::failed() && (DeepZoom::tiling() || !DeepZoom::settled()))
+        return true;
+    return Ryi::show_about || Ryi::debug.visible();
+}
+
 void Ryi::draw_background() {
     const int GRID_STEP = 20;
     auto w = GetScreenWidth();
@@ -46,14 +111,15 @@ void Ryi::draw_background() {
 }
 
 bool Ryi::is_image_supported(char* ext) {
-    if (ext == NULL) return false;
-
-    return
-        strcmp(ext, ".png") == 0 ||
-        strcmp(ext, ".jpg") == 0 ||
-        strcmp(ext, ".jpeg") == 0 ||
-        strcmp(ext, ".bmp") == 0 ||
-        strcmp(ext, ".gif") == 0;
+    return Ryi::file_format(ext) != FileFormat::UNKNOWN;
+}
+
+/*
+ * The format a file extension suggests. Only a guess, the scanner and the loader go by the file's
+ * magic bytes.
+ */
+FileFormat Ryi::file_format(const char* ext) {
+    return FileFormats::from_extension(ext);
 }
 
 Rectangle Ryi::get_dest_rect(ImageMode mode, float scaleFactor) {
@@ -81,6 +147,20 @@ Rectangle Ryi::get_dest_rect(ImageMode mode, float scaleFactor) {
     };
 }
 
+/*
+ * Largest rectangle with the aspect ratio of a `width` x `height` image that fits centered inside `rect`.
+ * Returns `rect` as is while the image dimensions are unknown.
+ */
+Rectangle Ryi::fit_rect(Rectangle rect, int width, int height) {
+    if (width <= 0 || height <= 0)
+        return rect;
+
+    float scale = fminf(rect.width / width, rect.height / height);
+    float fitted_w = width * scale;
+    float fitted_h = height * scale;
+    return {rect.x + (rect.width - fitted_w) / 2, rect.y + (rect.height - fitted_h) / 2, fitted_w, fitted_h};
+}
+
 void Ryi::open_app_from_url(char* url) {
     char command_buffer[255];
 #if defined(_WIN32) || defined(_WIN64)
@@ -96,72 +176,142 @@ void Ryi::open_app_from_url(char* url) {
 }
 
 std::vector<RenderImage> Ryi::Ryi::_images;
+std::unordered_map<unsigned int, size_t> Ryi::_image_slots;
+std::unordered_map<std::string, unsigned int> Ryi::_image_paths;
+unsigned int Ryi::_next_id = 1;
+/*
+ * Starts scanning `path` in the background, `update` adds the entries as they are found
+ * and reports an empty result once the scan is done.
+ */
 void Ryi::load_images(const char* path) {
-    Ryi::_images = RenderImage::load_images_from_dir(path);
-    if (Ryi::_images.size() > 0)
-        Ryi::image_index = 0;
-    else {
-        Ryi::image_index = -1;
-        if (path != NULL && *path == '.')
-            Ryi::debug.report("Failed to load images from current directory (`.`)");
-        else
-            Ryi::debug.report(TextFormat("Failed to load images from path: `%s`", path));
-    }
+    Ryi::image_index = -1;
+    DirWatcher::start(path);
+    DirScanner::start(path);
 }
 
-int write_data(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-    size_t written = fwrite(ptr, size, nmemb, stream);
-    return written;
+/*
+ * Adds a catalog entry for `url` right away and lets the loader download and decode it in the
+ * background, the window keeps drawing (and shows passes of progressive files) meanwhile.
+ */
+void Ryi::load_from_url(const char* url) {
+    Ryi::add_image((RenderImage){
+        .path = strdup(url),
+        .format = Ryi::file_format(GetFileExtension(url)),
+        .state = TextureState::LOADING,
+    });
+    ImageLoader::download(Ryi::_images.back(), url);
 }
 
-void Ryi::load_from_url(const char* url) {
 
-    char temp_path[] = "/tmp/imag.png";
+bool Ryi::is_url(const char* url) {
+    return url != NULL && (strncmp(url, "http://", 7) == 0 ||
+           strncmp(url, "https://", 8) == 0 ||
+           strncmp(url, "ftp://", 6) == 0);
+}
 
-    FILE *fp = fopen(temp_path, "wb");
+std::vector<RenderImage>& Ryi::images() {
+    return Ryi::_images;
+}
 
-    if (fp == NULL) {
-        Ryi::debug.report("Failed creating tmp file");
+void Ryi::add_image(RenderImage image) {
+    image.id = Ryi::_next_id++;
+    if (image.sort_key == NULL)
+        image.sort_key = CatalogSort::natural_key(image.path);
+    Ryi::_image_slots[image.id] = Ryi::_images.size();
+    Ryi::_image_paths[image.path] = image.id;
+    Ryi::_images.push_back(image);
+    if (Ryi::image_index < 0)
+        Ryi::image_index = 0;
+}
+
+/*
+ * Puts the catalog in `mode` order, keeping the image on screen selected. Entries keep their ids,
+ * so textures, cache slots and queued decodes are not affected.
+ */
+void Ryi::sort_images(SortMode mode) {
+    Ryi::sort_mode = mode;
+    if (Ryi::_images.empty())
         return;
-    }
 
+    // Timed as a whole, rebuilding the slots of a big catalog costs as much as sorting it.
+    double start = GetTime();
+    int selected = Ryi::image_index >= 0 ? (int)Ryi::_images[Ryi::image_index].id : -1;
+    CatalogSort::sort(Ryi::_images, mode);
+    for (size_t i = 0; i < Ryi::_images.size(); i++)
+        Ryi::_image_slots[Ryi::_images[i].id] = i;
+    if (selected >= 0)
+        Ryi::image_index = Ryi::image_slot(selected);
+    Ryi::sort_time = GetTime() - start;
+    TraceLog(LOG_INFO, "RYI: Sorted %zu images by %s in %.1f ms", Ryi::_images.size(), CatalogSort::name(mode), Ryi::sort_time * 1000);
+}
 
-    printf("Temporary file created at: %s\n", temp_path);
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-        CURLcode res = curl_easy_perform(curl);
-
-        if(res == CURLE_OK) {
-            printf("Image downloaded to temp storage successfully.\n");
-            fclose(fp);
-        } else {
-            Ryi::debug.report("Failed fetching image");
-            fclose(fp);
-        }
-        curl_easy_cleanup(curl);
-    }
+/*
+ * Drops a single entry (a file that was deleted or moved away), keeping the one on screen selected.
+ */
+void Ryi::remove_image(unsigned int id) {
+    auto slot = Ryi::_image_slots.find(id);
+    if (slot == Ryi::_image_slots.end())
+        return;
 
+    int index = (int)slot->second;
+    auto& image = Ryi::_images[index];
+    ImageLoader::withdraw(id, TextureKind::FULL);
+    ImageLoader::withdraw(id, TextureKind::THUMBNAIL);
+    image.unload();
+    Ryi::_image_paths.erase(image.path);
+    free(image.path);
+    free(image.sort_key);
+    Ryi::_images.erase(Ryi::_images.begin() + index);
+    Ryi::_image_slots.erase(slot);
+    for (size_t i = index; i < Ryi::_images.size(); i++)
+        Ryi::_image_slots[Ryi::_images[i].id] = i;
+
+    if (Ryi::image_index > index || Ryi::image_index >= (int)Ryi::_images.size())
+        Ryi::image_index--;
+}
 
-    auto image = LoadTexture(temp_path);
-    SetTextureFilter(image, TEXTURE_FILTER_ANISOTROPIC_16X);
-    Ryi::_images.push_back((RenderImage){.path = strdup(url), .image = image});
-    Ryi::image_index = 0;
+/*
+ * Looks a catalog entry up by its id. Ids stay valid while entries move around in `_images`,
+ * so background work refers to entries by id and not by index.
+ */
+RenderImage* Ryi::find_image(unsigned int id) {
+    auto slot = Ryi::_image_slots.find(id);
+    if (slot == Ryi::_image_slots.end())
+        return NULL;
+    return &Ryi::_images[slot->second];
 }
 
+RenderImage* Ryi::find_image(const char* path) {
+    auto id = Ryi::_image_paths.find(path);
+    if (id == Ryi::_image_paths.end())
+        return NULL;
+    return Ryi::find_image(id->second);
+}
 
-bool Ryi::is_url(const char* url) {
-    return url != NULL && (strncmp(url, "http://", 7) == 0 ||
-           strncmp(url, "https://", 8) == 0 ||
-           strncmp(url, "ftp://", 6) == 0);
+/*
+ * Position of an entry in `images()`, or -1.
+ */
+int Ryi::image_slot(unsigned int id) {
+    auto slot = Ryi::_image_slots.find(id);
+    return slot == Ryi::_image_slots.end() ? -1 : (int)slot->second;
 }
 
-std::vector<RenderImage> Ryi::images() {
-    return Ryi::_images;
+void Ryi::unload_images() {
+    Animation::stop();
+    DeepZoom::stop();
+    DirWatcher::stop();
+    DirScanner::stop();
+    ImageLoader::cancel();
+    for (auto& image: Ryi::_images) {
+        image.unload();
+        free(image.path);
+        free(image.sort_key);
+    }
+    Ryi::_images.clear();
+    Ryi::_image_slots.clear();
+    Ryi::_image_paths.clear();
+    Ryi::image_index = -1;
+    Prefetcher::reset();
 }
 
 void Ryi::draw_about() {
@@ -243,6 +393,39 @@ void Ryi::draw_about() {
     }
 }
 
+/*
+ * Debug overlay, toggled with F3. Shows frame time and texture cache counters,
+ * useful when sizing the cache budget (`-m`).
+ */
+void Ryi::draw_stats() {
+    const float MB = 1024.0f * 1024.0f;
+    int x = 10;
+    int y = GetScreenHeight() - 100;
+    DrawRectangle(x - 5, y - 95, 300, 165, Fade(BLACK, 0.7f));
+    DrawText(TextFormat("frames: %zu drawn  %zu skipped  idle: %.1f s%s", Idle::drawn(), Idle::skipped(), Idle::idle_time(), Idle::enabled ? "" : " (always redraw)"), x, y - 90, 12, GREEN);
+    DrawText(TextFormat("pool: %zu textures  %.1f MB  hits: %zu  misses: %zu", TexturePool::count(), TexturePool::bytes() / MB, TexturePool::hits(), TexturePool::misses()), x, y - 75, 12, GREEN);
+    if (UploadThread::running())
+        DrawText(TextFormat("upload: %.2f ms on the upload thread  queue: %zu %.1f ms", UploadThread::upload_time() * 1000, FrameQueue::pending(), FrameQueue::spent() * 1000), x, y - 60, 12, GREEN);
+    else
+        DrawText(TextFormat("upload: %.2f ms buffered  %.2f ms direct  queue: %zu %.1f ms", ImageLoader::upload_time(true) * 1000, ImageLoader::upload_time(false) * 1000, FrameQueue::pending(), FrameQueue::spent() * 1000), x, y - 60, 12, GREEN);
+    if (!Ryi::grid_view && Ryi::image_index >= 0 && Ryi::image_index < (int)Ryi::_images.size() && Ryi::_images[Ryi::image_index].state == TextureState::READY) {
+        auto texture = Ryi::_images[Ryi::image_index].image;
+        Texture2D rgba = texture;
+        rgba.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+        DrawText(TextFormat("image: %s  %.1f MB (RGBA8 %.1f MB)  uploaded: %.0f MB", ImageLoader::format_name(texture.format), ImageLoader::texture_bytes(texture) / MB, ImageLoader::texture_bytes(rgba) / MB, ImageLoader::uploaded() / MB), x, y - 45, 12, GREEN);
+    }
+    if (DeepZoom::active())
+        DrawText(TextFormat("tiles: %zu  %.1f MB  tiled: %.0f%%", DeepZoom::tiles(), DeepZoom::bytes() / MB, DeepZoom::progress() * 100), x, y - 30, 12, GREEN);
+    DrawText(TextFormat("scan: %zu images in %zu dirs%s%s  sort: %s %.1f ms", DirScanner::files(), DirScanner::directories(), Uring::enabled ? " (io_uring)" : "", DirScanner::scanning() ? " ..." : "", CatalogSort::name(Ryi::sort_mode), Ryi::sort_time * 1000), x, y - 15, 12, GREEN);
+    DrawText(TextFormat("fps: %d  frame: %.2f ms  peak rss: %.1f MB", GetFPS(), GetFrameTime() * 1000.0f, MappedFile::peak_rss_kb() / 1024.0f), x, y, 12, GREEN);
+    y += 15;
+    DrawText(TextFormat("cache: %.1f / %.1f MB  (%d textures)  %s", TextureCache::used() / MB, TextureCache::budget() / MB, (int)TextureCache::count(), TextureCodec::name(TextureCodec::compression)), x, y, 12, GREEN);
+    y += 15;
+    DrawText(TextFormat("hits: %zu  misses: %zu  evicted: %zu", TextureCache::hits(), TextureCache::misses(), TextureCache::evictions()), x, y, 12, GREEN);
+    y += 15;
+    DrawText(TextFormat("prefetch: %+d x%d  decode: %.0f ms  dwell: %.0f ms", Prefetcher::direction(), Prefetcher::ahead(), Prefetcher::decode_time() * 1000, Prefetcher::dwell_time() * 1000), x, y, 12, GREEN);
+}
+
 void Ryi::draw_grid_view() {
     auto w = GetScreenWidth();
     auto h = GetScreenHeight();
@@ -261,7 +444,7 @@ void Ryi::draw_grid_view() {
                     goto _out;
 
                 int index = i++ % Ryi::_images.size();
-                auto img = Ryi::_images[index];
+                auto& img = Ryi::_images[index];
                 auto rect = (Rectangle) {(float)x, (float)y, (float)grid_w, (float)grid_h};
                 // printf("rect.x: %2f, rect.width: %2f w: %2d, %f\n", rect.x, rect.width, w, rect.x + rect.width);
                 if ((rect.x + rect.width) > w) {
@@ -269,17 +452,23 @@ void Ryi::draw_grid_view() {
                     break;
                 }
 
-                auto image = img.image;
                 if (CheckCollisionPointRec(GetMousePosition(), rect)) {
                     hovered_rect = rect;
                     hovered_index = index;
                     continue;
+                }
+
+                auto cell = Ryi::fit_rect(rect, img.width, img.height);
+                auto thumbnail = img.request_thumbnail(cell.width, cell.height);
+                if (thumbnail == NULL) {
+                    DrawRectangleRec(cell, GetColor(0x262626ff));
                 } else {
+                    auto image = *thumbnail;
                     Color color = Ryi::_images.size() > 1 || i - 1 == 0 ? WHITE : Fade(RED, alpha);
                     DrawTexturePro(
                         image,
                         {0, 0, (float)image.width, (float)image.height},
-                        rect,
+                        cell,
                         {0, 0},
                         rotation,
                         color
@@ -305,18 +494,25 @@ void Ryi::draw_grid_view() {
                 hovered_rect.height -= 30;
             }
 
-            auto image = Ryi::_images[hovered_index].image;
-            auto image_path = Ryi::_images[hovered_index].path;
-            DrawTexturePro(
-                image,
-                {0, 0, (float)image.width, (float)image.height},
-                hovered_rect,
-                {0, 0},
-                rotation,
-                WHITE
-            );
+            auto& entry = Ryi::_images[hovered_index];
+            auto image_path = entry.path;
+            hovered_rect = Ryi::fit_rect(hovered_rect, entry.width, entry.height);
+            auto thumbnail = entry.request_thumbnail(hovered_rect.width, hovered_rect.height, true);
+            if (thumbnail != NULL) {
+                auto image = *thumbnail;
+                DrawTexturePro(
+                    image,
+                    {0, 0, (float)image.width, (float)image.height},
+                    hovered_rect,
+                    {0, 0},
+                    rotation,
+                    WHITE
+                );
+            } else {
+                DrawRectangleRec(hovered_rect, GetColor(0x262626ff));
+            }
             //DrawRectanglePro(hovered_rect, {0,0}, rotation, ORANGE);
-            DrawText(TextFormat("w: %d, h: %d", image.width, image.height), w - 120, h - 60, 14, RED);
+            DrawText(TextFormat("w: %d, h: %d, %dx%d bit", entry.width, entry.height, entry.channels, entry.bit_depth), w - 200, h - 60, 14, RED);
             DrawText(TextFormat("path: %s   [%d/%d]", image_path, hovered_index + 1, Ryi::_images.size() - 1), 20, h - 60, 14, RED);
             if (IsKeyPressed(KEY_ENTER) || IsMouseButtonPressed(MOUSE_MIDDLE_BUTTON)) {
                 image_index = hovered_index;
@@ -331,9 +527,23 @@ void Ryi::draw_grid_view() {
 }
 
 void Ryi::draw_image_slide() {
-    if (Ryi::_images.size() > 0) {
-        auto image = Ryi::_images[image_index].image;
+    if (Ryi::_images.size() > 0 && image_index >= 0) {
+        auto& entry = Ryi::_images[image_index];
         auto rect = Ryi::get_dest_rect(image_mode, scale_factor);
+        if (entry.tiled()) {
+            if (!DeepZoom::draw(entry, rect, rotation)) {
+                const char* status = DeepZoom::failed() ? "Failed to decode image" : "Loading...";
+                DrawText(status, GetScreenWidth() / 2 - MeasureText(status, 20) / 2, GetScreenHeight() / 2, 20, GRAY);
+            }
+            return;
+        }
+        if (!entry.request(true, rect.width, rect.height)) {
+            const char* status = entry.state == TextureState::FAILED ? "Failed to decode image" : "Loading...";
+            DrawText(status, GetScreenWidth() / 2 - MeasureText(status, 20) / 2, GetScreenHeight() / 2, 20, GRAY);
+            return;
+        }
+
+        auto image = entry.image;
 
         if (image_mode == ImageMode::CENTERED) {
             DrawRectanglePro({rect.x + 5, rect.y + 5, rect.width, rect.height}, {0, 0}, rotation, GetColor(0x000000ee));
@@ -11,8 +11,11 @@
 #define RYI_H
 
 #include <raylib.h>
+#include <string>
+#include <unordered_map>
 #include "imagemode.h"
 #include "renderimage.h"
+#include "catalogsort.h"
 #include "errorview.h"
 /*
  * Ryi struct
@@ -21,30 +24,50 @@
 struct Ryi {
 public:
     static void init(char *flag);
+    static void update();
     static void draw_background();
     static bool is_image_supported(char*);
+    static FileFormat file_format(const char*);
     static Rectangle get_dest_rect(ImageMode, float);
+    static Rectangle fit_rect(Rectangle, int, int);
     static void open_app_from_url(char*);
     static void load_images(const char*);
     static void load_from_url(const char* url);
     static bool is_url(const char* url);
-    static std::vector<RenderImage> images();
+    static std::vector<RenderImage>& images();
+    static void add_image(RenderImage);
+    static RenderImage* find_image(unsigned int id);
+    static RenderImage* find_image(const char* path);
+    static int image_slot(unsigned int id);
+    static void remove_image(unsigned int id);
+    static void sort_images(SortMode mode);
+    static void unload_images();
 
     static void draw_about();
+    static void draw_stats();
     static void draw_grid_view();
     static void draw_image_slide();
+    static bool animating();
 
     static int image_index;
     static bool grid_view;
     static bool is_running;
     static bool show_about;
+    static bool show_stats;
+    static bool follow_newest;
+    static SortMode sort_mode;
+    static double sort_time;
     static float scale_factor;
     static float rotation;
     static Rectangle dialog_rect;
     static ImageMode image_mode;
     static int scroll_y;
     static ErrorView debug;
+    static const char* download_path;
 private:
     static std::vector<RenderImage> _images;
+    static std::unordered_map<unsigned int, size_t> _image_slots;
+    static std::unordered_map<std::string, unsigned int> _image_paths;
+    static unsigned int _next_id;
 };
 #endif // RYI_H
@@ -0,0 +1,105 @@
+#include "texturecache.h"
+#include <algorithm>
+#include "ryi.h"
+#include "texturepool.h"
+
+std::list<TextureCache::Key> TextureCache::_lru;
+std::unordered_map<TextureCache::Key, TextureCache::Slot> TextureCache::_entries;
+size_t TextureCache::_budget = 512ul * 1024 * 1024;
+size_t TextureCache::_used = 0;
+size_t TextureCache::_hits = 0;
+size_t TextureCache::_misses = 0;
+size_t TextureCache::_evictions = 0;
+unsigned long TextureCache::_frame = 0;
+unsigned long TextureCache::_drawn_frame = 0;
+unsigned long TextureCache::_previous_drawn_frame = 0;
+
+// `drawn` of a texture that was decoded after a miss and has not been drawn yet.
+const unsigned long NOT_DRAWN = ~0ul;
+
+void TextureCache::budget(size_t bytes) {
+    _budget = bytes;
+    TextureCache::trim();
+}
+
+void TextureCache::begin_frame() {
+    _frame++;
+}
+
+void TextureCache::insert(unsigned int id, TextureKind kind, size_t bytes) {
+    TextureCache::remove(id, kind);
+    _lru.push_front(key(id, kind));
+    _entries[key(id, kind)] = (Slot){.lru = _lru.begin(), .bytes = bytes, .frame = _frame, .drawn = NOT_DRAWN};
+    _used += bytes;
+    TextureCache::trim();
+}
+
+void TextureCache::remove(unsigned int id, TextureKind kind) {
+    auto entry = _entries.find(key(id, kind));
+    if (entry == _entries.end())
+        return;
+    _used -= entry->second.bytes;
+    _lru.erase(entry->second.lru);
+    _entries.erase(entry);
+}
+
+/*
+ * Marks a texture as drawn this frame and moves it to the front of the LRU list. Counts a hit when
+ * it was not drawn in the previous drawn frame, frames the idle loop skipped do not count as gaps.
+ */
+void TextureCache::touch(unsigned int id, TextureKind kind) {
+    auto entry = _entries.find(key(id, kind));
+    if (entry == _entries.end())
+        return;
+    if (_drawn_frame != _frame) {
+        _previous_drawn_frame = _drawn_frame;
+        _drawn_frame = _frame;
+    }
+    auto& drawn = entry->second.drawn;
+    if (drawn != NOT_DRAWN && drawn != _frame && drawn != _previous_drawn_frame)
+        _hits++;
+    drawn = _frame;
+    TextureCache::keep(id, kind);
+}
+
+/*
+ * Like `touch`, without counting a hit. Used for textures kept warm by the prefetcher.
+ */
+void TextureCache::keep(unsigned int id, TextureKind kind) {
+    auto entry = _entries.find(key(id, kind));
+    if (entry == _entries.end())
+        return;
+    entry->second.frame = _frame;
+    _lru.splice(_lru.begin(), _lru, entry->second.lru);
+}
+
+void TextureCache::miss() {
+    _misses++;
+}
+
+void TextureCache::trim() {
+    auto it = _lru.end();
+    size_t pooled = std::min(TexturePool::bytes(), _budget / TEXTURE_POOL_SHARE);
+    while (_used + pooled > _budget && it != _lru.begin()) {
+        --it;
+        auto& slot = _entries[*it];
+        if (slot.frame == _frame)
+            continue;
+
+        auto evicted = *it;
+        it = _lru.erase(it);
+        _used -= slot.bytes;
+        _entries.erase(evicted);
+        _evictions++;
+
+        auto image = Ryi::find_image((unsigned int)evicted);
+        if (image != NULL)
+            image->unload((TextureKind)(evicted >> 32));
+    }
+}
+
+void TextureCache::clear() {
+    _lru.clear();
+    _entries.clear();
+    _used = 0;
+}
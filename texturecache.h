@@ -0,0 +1,69 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <list>
+#include <stddef.h>
+#include <unordered_map>
+#include "renderimage.h"
+
+/*
+ * TextureCache struct.
+ * Keeps track of how much VRAM the uploaded catalog textures (full images and thumbnail pyramids) use and unloads the least recently
+ * drawn ones once the byte budget is exceeded. Evicted entries go back to TextureState::EMPTY,
+ * so the next `RenderImage::request` transparently decodes them again.
+ * Textures drawn in the current frame are never evicted, even when they alone exceed the budget.
+ * Textures in the TexturePool count against the budget too, up to the pool's share of it.
+ * A hit is a texture that was already there when it came on screen, not one per frame it stays there,
+ * so hits and misses (one per decode) compare like for like when tuning the budget.
+ */
+struct TextureCache {
+public:
+    static void budget(size_t bytes);
+    static size_t budget() { return _budget; }
+    static size_t used() { return _used; }
+    static size_t hits() { return _hits; }
+    static size_t misses() { return _misses; }
+    static size_t evictions() { return _evictions; }
+    static size_t count() { return _entries.size(); }
+
+    static void begin_frame();
+    static void insert(unsigned int id, TextureKind kind, size_t bytes);
+    static void remove(unsigned int id, TextureKind kind);
+    static void touch(unsigned int id, TextureKind kind);
+    static void keep(unsigned int id, TextureKind kind);
+    static void miss();
+    static void trim();
+    static void clear();
+
+private:
+    using Key = unsigned long long;
+    static Key key(unsigned int id, TextureKind kind) { return ((Key)kind << 32) | id; }
+
+    struct Slot {
+        std::list<Key>::iterator lru;
+        size_t bytes;
+        unsigned long frame;
+        unsigned long drawn;
+    };
+
+    static std::list<Key> _lru;
+    static std::unordered_map<Key, Slot> _entries;
+    static size_t _budget;
+    static size_t _used;
+    static size_t _hits;
+    static size_t _misses;
+    static size_t _evictions;
+    static unsigned long _frame;
+    static unsigned long _drawn_frame;
+    static unsigned long _previous_drawn_frame;
+};
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,457 @@
+#include "texturecodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <chrono>
+#include <vector>
+#include "fileformat.h"
+
+// Images read by `benchmark`.
+const int CODEC_BENCH_FILES = 8;
+const int CODEC_REFINE_STEPS = 2;
+
+TextureCompression TextureCodec::compression = TextureCompression::NONE;
+CompressionQuality TextureCodec::quality = CompressionQuality::FAST;
+
+static int clamp_byte(float value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (int)(value + 0.5f);
+}
+
+static int to_565(const float color[3]) {
+    int r = (clamp_byte(color[0]) * 31 + 127) / 255;
+    int g = (clamp_byte(color[1]) * 63 + 127) / 255;
+    int b = (clamp_byte(color[2]) * 31 + 127) / 255;
+    return (r << 11) | (g << 5) | b;
+}
+
+static void from_565(int value, int color[3]) {
+    int r = (value >> 11) & 31;
+    int g = (value >> 5) & 63;
+    int b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/*
+ * Picks the closest of the four colors between `c0` and `c1` for every pixel of the block.
+ * Returns the squared error, the 2 bit indices go to `indices`.
+ */
+static int color_indices(const unsigned char* block, int c0, int c1, unsigned int* indices) {
+    int palette[4][3];
+    from_565(c0, palette[0]);
+    from_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    int error = 0;
+    *indices = 0;
+    for (int i = 0; i < 16; i++) {
+        const unsigned char* pixel = block + i * 4;
+        int best = 0;
+        int best_distance = 1 << 30;
+        for (int index = 0; index < 4; index++) {
+            int dr = pixel[0] - palette[index][0];
+            int dg = pixel[1] - palette[index][1];
+            int db = pixel[2] - palette[index][2];
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < best_distance) {
+                best_distance = distance;
+                best = index;
+            }
+        }
+        *indices |= (unsigned int)best << (2 * i);
+        error += best_distance;
+    }
+    return error;
+}
+
+/*
+ * Endpoints that best fit the block for the indices it has now (least squares per channel),
+ * every index standing for a fixed mix of the two endpoints.
+ */
+static bool refine_endpoints(const unsigned char* block, unsigned int indices, float c0[3], float c1[3]) {
+    static const float WEIGHTS[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0, ab = 0, bb = 0;
+    float ax[3] = {0}, bx[3] = {0};
+    for (int i = 0; i < 16; i++) {
+        float a = WEIGHTS[(indices >> (2 * i)) & 3];
+        float b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++) {
+            ax[c] += a * block[i * 4 + c];
+            bx[c] += b * block[i * 4 + c];
+        }
+    }
+
+    float determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) < 1e-6f)
+        return false;
+    for (int c = 0; c < 3; c++) {
+        c0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+        c1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+    }
+    return true;
+}
+
+/*
+ * Encodes the color of a 4x4 RGBA block into 8 bytes of BC1. The endpoints are always stored
+ * with c0 > c1, which selects the four color mode in BC1 and is what BC3 assumes anyway.
+ */
+void TextureCodec::encode_color(const unsigned char* block, unsigned char* out, CompressionQuality quality) {
+    float low[3] = {255, 255, 255};
+    float high[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            low[c] = fminf(low[c], block[i * 4 + c]);
+            high[c] = fmaxf(high[c], block[i * 4 + c]);
+        }
+    }
+    // Moving the corners of the box inwards by 1/16 lands the interpolated colors closer to the pixels.
+    for (int c = 0; c < 3; c++) {
+        float inset = (high[c] - low[c]) / 16.0f;
+        low[c] += inset;
+        high[c] -= inset;
+    }
+
+    int best_c0 = to_565(high);
+    int best_c1 = to_565(low);
+    unsigned int best_indices;
+    int best_error = color_indices(block, best_c0, best_c1, &best_indices);
+
+    if (quality == CompressionQuality::HIGH && best_error > 0) {
+        float mean[3] = {0};
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i * 4 + c] / 16.0f;
+        }
+        float covariance[6] = {0};
+        for (int i = 0; i < 16; i++) {
+            float r = block[i * 4] - mean[0];
+            float g = block[i * 4 + 1] - mean[1];
+            float b = block[i * 4 + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // Principal axis by power iteration, started from the diagonal of the bounding box.
+        float axis[3] = {high[0] - low[0] + 1, high[1] - low[1] + 1, high[2] - low[2] + 1};
+        for (int step = 0; step < 8; step++) {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float length = sqrtf(x * x + y * y + z * z);
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+
+        float lowest = 1e9f, highest = -1e9f;
+        for (int i = 0; i < 16; i++) {
+            float t = (block[i * 4] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+            lowest = fminf(lowest, t);
+            highest = fmaxf(highest, t);
+        }
+        float c0[3], c1[3];
+        for (int c = 0; c < 3; c++) {
+            c0[c] = mean[c] + axis[c] * highest;
+            c1[c] = mean[c] + axis[c] * lowest;
+        }
+
+        for (int step = 0; step <= CODEC_REFINE_STEPS; step++) {
+            int e0 = to_565(c0);
+            int e1 = to_565(c1);
+            if (e0 < e1) {
+                int swap = e0;
+                e0 = e1;
+                e1 = swap;
+            }
+            unsigned int indices;
+            int error = color_indices(block, e0, e1, &indices);
+            if (error < best_error) {
+                best_error = error;
+                best_c0 = e0;
+                best_c1 = e1;
+                best_indices = indices;
+            }
+            if (step == CODEC_REFINE_STEPS || !refine_endpoints(block, indices, c0, c1))
+                break;
+        }
+    }
+
+    if (best_c0 < best_c1) {
+        int swap = best_c0;
+        best_c0 = best_c1;
+        best_c1 = swap;
+        color_indices(block, best_c0, best_c1, &best_indices);
+    } else if (best_c0 == best_c1) {
+        best_indices = 0;
+    }
+
+    out[0] = best_c0 & 0xFF;
+    out[1] = best_c0 >> 8;
+    out[2] = best_c1 & 0xFF;
+    out[3] = best_c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (best_indices >> (8 * i)) & 0xFF;
+}
+
+/*
+ * Encodes the alpha of a 4x4 RGBA block into the 8 byte BC3 alpha block: the largest and smallest
+ * alpha as endpoints, six values between them, a 3 bit index per pixel.
+ */
+void TextureCodec::encode_alpha(const unsigned char* block, unsigned char* out) {
+    int high = 0, low = 255;
+    for (int i = 0; i < 16; i++) {
+        high = block[i * 4 + 3] > high ? block[i * 4 + 3] : high;
+        low = block[i * 4 + 3] < low ? block[i * 4 + 3] : low;
+    }
+
+    int values[8] = {high, low};
+    for (int i = 2; i < 8; i++)
+        values[i] = ((8 - i) * high + (i - 1) * low) / 7;
+
+    unsigned long long indices = 0;
+    if (high != low) {
+        for (int i = 0; i < 16; i++) {
+            int alpha = block[i * 4 + 3];
+            int best = 0;
+            for (int index = 1; index < 8; index++) {
+                if (abs(values[index] - alpha) < abs(values[best] - alpha))
+                    best = index;
+            }
+            indices |= (unsigned long long)best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+/*
+ * Turns a BC1 (or, with `alpha`, BC3) block back into 4x4 RGBA pixels. Used by `benchmark` to measure quality.
+ */
+void TextureCodec::decode_block(const unsigned char* in, bool alpha, unsigned char* block) {
+    if (alpha) {
+        int values[8] = {in[0], in[1]};
+        for (int i = 2; i < 8; i++)
+            values[i] = in[0] > in[1] ? ((8 - i) * in[0] + (i - 1) * in[1]) / 7 : i < 6 ? ((6 - i) * in[0] + (i - 1) * in[1]) / 5 : (i == 6 ? 0 : 255);
+        unsigned long long indices = 0;
+        for (int i = 0; i < 6; i++)
+            indices |= (unsigned long long)in[2 + i] << (8 * i);
+        for (int i = 0; i < 16; i++)
+            block[i * 4 + 3] = (unsigned char)values[(indices >> (3 * i)) & 7];
+        in += 8;
+    } else {
+        for (int i = 0; i < 16; i++)
+            block[i * 4 + 3] = 255;
+    }
+
+    int c0 = in[0] | (in[1] << 8);
+    int c1 = in[2] | (in[3] << 8);
+    int palette[4][3];
+    from_565(c0, palette[0]);
+    from_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        if (c0 > c1 || alpha) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    unsigned int indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+    for (int i = 0; i < 16; i++) {
+        int* color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 3; c++)
+            block[i * 4 + c] = (unsigned char)color[c];
+    }
+}
+
+/*
+ * Bytes of a mip level in `format`. Block compressed levels take whole 4x4 blocks, partial ones included.
+ */
+size_t TextureCodec::level_bytes(int width, int height, int format) {
+    if (format == PIXELFORMAT_COMPRESSED_DXT1_RGB || format == PIXELFORMAT_COMPRESSED_DXT1_RGBA)
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+    if (format == PIXELFORMAT_COMPRESSED_DXT3_RGBA || format == PIXELFORMAT_COMPRESSED_DXT5_RGBA)
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+    return GetPixelDataSize(width, height, format);
+}
+
+/*
+ * Encodes every level of an RGBA image into one block compressed Image. Blocks that reach past the
+ * right or bottom edge of a level read its last column and row again, GL ignores those texels.
+ */
+Image TextureCodec::encode(Image& rgba, bool alpha, CompressionQuality quality) {
+    int format = alpha ? PIXELFORMAT_COMPRESSED_DXT5_RGBA : PIXELFORMAT_COMPRESSED_DXT1_RGB;
+    size_t size = 0;
+    for (int level = 0, width = rgba.width, height = rgba.height; level < rgba.mipmaps; level++) {
+        size += TextureCodec::level_bytes(width, height, format);
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    unsigned char* data = (unsigned char*)malloc(size);
+    unsigned char* out = data;
+    const unsigned char* level = (const unsigned char*)rgba.data;
+    int width = rgba.width;
+    int height = rgba.height;
+    for (int i = 0; i < rgba.mipmaps; i++) {
+        unsigned char block[64];
+        for (int y = 0; y < height; y += 4) {
+            for (int x = 0; x < width; x += 4) {
+                for (int row = 0; row < 4; row++) {
+                    int source_y = y + row < height ? y + row : height - 1;
+                    for (int column = 0; column < 4; column++) {
+                        int source_x = x + column < width ? x + column : width - 1;
+                        memcpy(block + row * 16 + column * 4, level + ((size_t)source_y * width + source_x) * 4, 4);
+                    }
+                }
+                if (alpha) {
+                    TextureCodec::encode_alpha(block, out);
+                    out += 8;
+                }
+                TextureCodec::encode_color(block, out, quality);
+                out += 8;
+            }
+        }
+        level += (size_t)width * height * 4;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+
+    return (Image){
+        .data = data,
+        .width = rgba.width,
+        .height = rgba.height,
+        .mipmaps = rgba.mipmaps,
+        .format = format,
+    };
+}
+
+static bool has_alpha(Image& rgba) {
+    const unsigned char* pixels = (const unsigned char*)rgba.data;
+    for (size_t i = 0; i < (size_t)rgba.width * rgba.height; i++) {
+        if (pixels[i * 4 + 3] != 255)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Replaces a freshly decoded image (without mipmaps) with its block compressed version and mip chain,
+ * as `compression` asks. Returns false, leaving the image alone, when compression is off.
+ */
+bool TextureCodec::compress(Image& image) {
+    if (compression == TextureCompression::NONE || image.data == NULL)
+        return false;
+
+    if (image.format != PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+        ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    bool alpha = compression == TextureCompression::BC3 || (compression == TextureCompression::AUTO && has_alpha(image));
+    ImageMipmaps(&image);
+
+    Image compressed = TextureCodec::encode(image, alpha, quality);
+    UnloadImage(image);
+    image = compressed;
+    return true;
+}
+
+const char* TextureCodec::name(TextureCompression compression) {
+    switch (compression) {
+    case TextureCompression::BC1: return "bc1";
+    case TextureCompression::BC3: return "bc3";
+    case TextureCompression::AUTO: return "auto";
+    default: return "none";
+    }
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+/*
+ * Transcodes the first images of `path` with every format and quality, printing the throughput and
+ * the PSNR of the result against the decoded image. Only the full size level is measured.
+ */
+void TextureCodec::benchmark(const char* path) {
+    std::vector<Image> images;
+    DIR* dir = opendir(path);
+    dirent* next_dir = dir != NULL ? readdir(dir) : NULL;
+    while (next_dir != NULL && (int)images.size() < CODEC_BENCH_FILES) {
+        if (FileFormats::from_extension(strrchr(next_dir->d_name, '.')) != FileFormat::UNKNOWN) {
+            auto image = LoadImage(TextFormat("%s/%s", path, next_dir->d_name));
+            if (image.data != NULL && image.width >= 4 && image.height >= 4) {
+                ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+                ImageResize(&image, image.width & ~3, image.height & ~3);
+                images.push_back(image);
+            } else {
+                UnloadImage(image);
+            }
+        }
+        next_dir = readdir(dir);
+    }
+    if (dir != NULL)
+        closedir(dir);
+
+    double pixels = 0;
+    for (auto& image: images)
+        pixels += (double)image.width * image.height;
+
+    for (int format = 0; format < 2; format++) {
+        for (int level = 0; level < 2; level++) {
+            bool alpha = format == 1;
+            auto quality = (CompressionQuality)level;
+            double squared = 0;
+            auto start = std::chrono::steady_clock::now();
+            std::vector<Image> encoded;
+            for (auto& image: images)
+                encoded.push_back(TextureCodec::encode(image, alpha, quality));
+            double elapsed = seconds_since(start);
+
+            for (size_t i = 0; i < images.size(); i++) {
+                const unsigned char* blocks = (const unsigned char*)encoded[i].data;
+                const unsigned char* source = (const unsigned char*)images[i].data;
+                int width = images[i].width;
+                for (int y = 0; y < images[i].height; y += 4) {
+                    for (int x = 0; x < width; x += 4, blocks += alpha ? 16 : 8) {
+                        unsigned char block[64];
+                        TextureCodec::decode_block(blocks, alpha, block);
+                        for (int j = 0; j < 16; j++) {
+                            for (int c = 0; c < (alpha ? 4 : 3); c++) {
+                                int difference = block[j * 4 + c] - source[((size_t)(y + j / 4) * width + x + j % 4) * 4 + c];
+                                squared += difference * difference;
+                            }
+                        }
+                    }
+                }
+                UnloadImage(encoded[i]);
+            }
+
+            double mse = pixels > 0 ? squared / (pixels * (alpha ? 4 : 3)) : 0;
+            double psnr = mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99;
+            printf("%s %-4s:  %8zu images %8.3f s %8.1f MP/s  %6.2f dB PSNR  %dx smaller than RGBA\n",
+                alpha ? "bc3" : "bc1", quality == CompressionQuality::HIGH ? "high" : "fast",
+                images.size(), elapsed, pixels / 1e6 / elapsed, psnr, alpha ? 4 : 8);
+        }
+    }
+    for (auto& image: images)
+        UnloadImage(image);
+}
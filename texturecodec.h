@@ -0,0 +1,62 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef TEXTURECODEC_H
+#define TEXTURECODEC_H
+
+#include <stddef.h>
+#include <raylib.h>
+
+/*
+ * TextureCompression enum.
+ * What decoded images are transcoded to before upload. AUTO picks BC1 for opaque images and BC3
+ * for those with an alpha channel.
+ */
+enum class TextureCompression {
+    NONE = 0,
+    BC1,
+    BC3,
+    AUTO,
+};
+
+/*
+ * CompressionQuality enum.
+ * FAST takes the endpoints of a block from its bounding box, HIGH fits them along the block's
+ * principal axis and refines them with least squares.
+ */
+enum class CompressionQuality {
+    FAST = 0,
+    HIGH,
+};
+
+/*
+ * TextureCodec struct.
+ * A CPU transcoder to the S3TC block formats: BC1 (DXT1) stores a 4x4 block of color in 8 bytes,
+ * BC3 (DXT5) adds 8 bytes of alpha, so a texture takes 1/8 or 1/4 of its RGBA size in VRAM.
+ * Runs on the loader workers. Every level down to 1x1 is encoded, the blocks along the right and bottom
+ * edge of a side that is no multiple of 4 repeat its last pixels. raylib sizes such levels as if there
+ * were no partial blocks, `level_bytes` has the sizes GL expects.
+ */
+struct TextureCodec {
+public:
+    static bool compress(Image& image);
+    static size_t level_bytes(int width, int height, int format);
+    static void benchmark(const char* path);
+    static const char* name(TextureCompression compression);
+
+    static TextureCompression compression;
+    static CompressionQuality quality;
+
+private:
+    static void encode_color(const unsigned char* block, unsigned char* out, CompressionQuality quality);
+    static void encode_alpha(const unsigned char* block, unsigned char* out);
+    static void decode_block(const unsigned char* in, bool alpha, unsigned char* block);
+    static Image encode(Image& rgba, bool alpha, CompressionQuality quality);
+};
+
+#endif // TEXTURECODEC_H
@@ -0,0 +1,89 @@
+#include "texturepool.h"
+#include <algorithm>
+#include <vector>
+#include "imageloader.h"
+#include "texturecache.h"
+
+std::unordered_multimap<TexturePool::Key, PooledTexture> TexturePool::_textures;
+size_t TexturePool::_bytes = 0;
+size_t TexturePool::_hits = 0;
+size_t TexturePool::_misses = 0;
+
+TexturePool::Key TexturePool::key(int width, int height, int format, int mipmaps) {
+    return ((Key)width << 40) | ((Key)height << 16) | ((Key)format << 8) | (Key)mipmaps;
+}
+
+/*
+ * Returns a pooled texture with exactly this size, format and mip count (its contents are stale),
+ * or one with id 0 when there is none and the caller has to load a new one.
+ */
+Texture2D TexturePool::acquire(int width, int height, int format, int mipmaps) {
+    auto found = _textures.find(key(width, height, format, mipmaps));
+    if (found == _textures.end()) {
+        _misses++;
+        return (Texture2D){0};
+    }
+    _hits++;
+    auto texture = found->second.texture;
+    _bytes -= found->second.bytes;
+    _textures.erase(found);
+    return texture;
+}
+
+void TexturePool::release(Texture2D texture) {
+    if (texture.id == 0)
+        return;
+    size_t bytes = ImageLoader::texture_bytes(texture);
+    _textures.insert({key(texture.width, texture.height, texture.format, texture.mipmaps), {.texture = texture, .bytes = bytes, .time = GetTime()}});
+    _bytes += bytes;
+}
+
+/*
+ * Bytes the pool may keep: TEXTURE_POOL_BYTES, a TEXTURE_POOL_SHARE of the cache budget and whatever
+ * of that budget the cached textures leave, whichever is least.
+ */
+size_t TexturePool::limit() {
+    size_t limit = std::min(TEXTURE_POOL_BYTES, TextureCache::budget() / TEXTURE_POOL_SHARE);
+    size_t left = TextureCache::budget() > TextureCache::used() ? TextureCache::budget() - TextureCache::used() : 0;
+    return std::min(limit, left);
+}
+
+/*
+ * Called once per loop iteration, after drawing or skipping the frame. Deletes the textures that
+ * waited too long, then the oldest ones until the pool fits its `limit`. Ages are in seconds, frames
+ * stop counting while the render loop idles.
+ */
+void TexturePool::trim() {
+    double now = GetTime();
+    size_t limit = TexturePool::limit();
+    std::vector<std::pair<double, std::unordered_multimap<Key, PooledTexture>::iterator>> oldest;
+    for (auto it = _textures.begin(); it != _textures.end();) {
+        if (now - it->second.time > TEXTURE_POOL_SECONDS) {
+            UnloadTexture(it->second.texture);
+            _bytes -= it->second.bytes;
+            it = _textures.erase(it);
+        } else {
+            if (_bytes > limit)
+                oldest.push_back({it->second.time, it});
+            ++it;
+        }
+    }
+    if (_bytes <= limit)
+        return;
+
+    std::sort(oldest.begin(), oldest.end(), [](auto& a, auto& b) { return a.first < b.first; });
+    for (auto& pooled: oldest) {
+        if (_bytes <= limit)
+            break;
+        UnloadTexture(pooled.second->second.texture);
+        _bytes -= pooled.second->second.bytes;
+        _textures.erase(pooled.second);
+    }
+}
+
+void TexturePool::clear() {
+    for (auto& pooled: _textures)
+        UnloadTexture(pooled.second.texture);
+    _textures.clear();
+    _bytes = 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef TEXTUREPOOL_H
+#define TEXTUREPOOL_H
+
+#include <stddef.h>
+#include <raylib.h>
+#include <unordered_map>
+
+// Unused textures kept for reuse (at most this much, and at most this share of the TextureCache budget),
+// and how many seconds one may wait for an image of its size.
+const size_t TEXTURE_POOL_BYTES = 256ul * 1024 * 1024;
+const size_t TEXTURE_POOL_SHARE = 8;
+const double TEXTURE_POOL_SECONDS = 2.0;
+
+/*
+ * PooledTexture struct.
+ * A texture nothing draws any more, its size in VRAM and the time it was given back.
+ */
+struct PooledTexture {
+    Texture2D texture;
+    size_t bytes;
+    double time;
+};
+
+/*
+ * TexturePool struct.
+ * Texture objects that were unloaded, kept by size, format and mip count so the next image with the
+ * same ones (a folder of photos from one camera, deep zoom tiles) is written into an existing texture
+ * instead of a new one being allocated. Nothing is deleted when it is given back, `trim` deletes
+ * once per loop iteration, after the frame is drawn (or skipped), whatever waited longer than
+ * TEXTURE_POOL_SECONDS or does not fit `limit`. Pooled bytes count against the TextureCache budget,
+ * the pool and the cache together stay within `-m`. Main thread only.
+ */
+struct TexturePool {
+public:
+    static Texture2D acquire(int width, int height, int format, int mipmaps);
+    static void release(Texture2D texture);
+    static void trim();
+    static void clear();
+
+    static size_t hits() { return _hits; }
+    static size_t misses() { return _misses; }
+    static size_t bytes() { return _bytes; }
+    static size_t count() { return _textures.size(); }
+    static size_t limit();
+
+private:
+    using Key = unsigned long long;
+    static Key key(int width, int height, int format, int mipmaps);
+
+    static std::unordered_multimap<Key, PooledTexture> _textures;
+    static size_t _bytes;
+    static size_t _hits;
+    static size_t _misses;
+};
+
+#endif // TEXTUREPOOL_H
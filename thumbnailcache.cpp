@@ -0,0 +1,311 @@
+#include "thumbnailcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+/*
+ * Freedesktop size directories, matching the thumbnail pyramid levels 128, 256 and 512.
+ * `load` prefers the largest one, `store` writes all three so file managers can use them too.
+ */
+struct ThumbnailSize {
+    const char* name;
+    int level;
+};
+const ThumbnailSize THUMBNAIL_CACHE_SIZES[] = {
+    {"x-large", 3},
+    {"large", 2},
+    {"normal", 1},
+};
+
+static unsigned int read_be32(const unsigned char* data) {
+    return ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) | ((unsigned int)data[2] << 8) | data[3];
+}
+
+static void write_be32(std::vector<unsigned char>& out, unsigned int value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    struct stat st;
+    unsigned char* data = NULL;
+    if (fstat(fileno(fp), &st) == 0 && st.st_size > 0) {
+        data = (unsigned char*)malloc(st.st_size);
+        if (data != NULL && fread(data, 1, st.st_size, fp) != (size_t)st.st_size) {
+            free(data);
+            data = NULL;
+        }
+        *size = st.st_size;
+    }
+    fclose(fp);
+    return data;
+}
+
+bool ThumbnailCache::load(const char* path, time_t mtime, Image* image, int* width, int* height) {
+    *image = {0};
+    char uri[PATH_MAX * 3 + 8];
+    char hash[33];
+    if (!ThumbnailCache::uri(path, uri, sizeof(uri)))
+        return false;
+    ThumbnailCache::md5(uri, hash);
+
+    for (auto& size: THUMBNAIL_CACHE_SIZES) {
+        char file[PATH_MAX];
+        if (!ThumbnailCache::directory(size.name, file, sizeof(file)))
+            return false;
+        size_t length = strlen(file);
+        snprintf(file + length, sizeof(file) - length, "/%s.png", hash);
+
+        size_t file_size = 0;
+        unsigned char* data = read_file(file, &file_size);
+        if (data == NULL)
+            continue;
+
+        // Walk the chunks for the Thumb:: text keys. A thumbnail is only valid for the exact
+        // file (URI) and version (MTime) it was made from.
+        bool uri_matches = false;
+        bool mtime_matches = false;
+        size_t offset = 8;
+        if (file_size < 8 || memcmp(data, "\x89PNG\r\n\x1a\n", 8) != 0)
+            offset = file_size;
+        while (offset + 12 <= file_size) {
+            unsigned int chunk_size = read_be32(data + offset);
+            const unsigned char* type = data + offset + 4;
+            const char* body = (const char*)data + offset + 8;
+            if (offset + 12 + chunk_size > file_size || memcmp(type, "IEND", 4) == 0)
+                break;
+
+            if (memcmp(type, "tEXt", 4) == 0) {
+                size_t key_length = strnlen(body, chunk_size);
+                if (key_length < chunk_size) {
+                    const char* value = body + key_length + 1;
+                    int value_length = chunk_size - key_length - 1;
+                    if (strcmp(body, "Thumb::URI") == 0)
+                        uri_matches = value_length == (int)strlen(uri) && memcmp(value, uri, value_length) == 0;
+                    else if (strcmp(body, "Thumb::MTime") == 0)
+                        mtime_matches = strtoll(std::string(value, value_length).c_str(), NULL, 10) == (long long)mtime;
+                    else if (strcmp(body, "Thumb::Image::Width") == 0)
+                        *width = atoi(std::string(value, value_length).c_str());
+                    else if (strcmp(body, "Thumb::Image::Height") == 0)
+                        *height = atoi(std::string(value, value_length).c_str());
+                }
+            }
+            offset += 12 + chunk_size;
+        }
+
+        if (uri_matches && mtime_matches)
+            *image = LoadImageFromMemory(".png", data, file_size);
+        free(data);
+        if (image->data != NULL)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Writes the 128, 256 and 512 levels of a freshly built pyramid. raylib encodes the PNG, the
+ * Thumb:: tEXt chunks are spliced in right after IHDR. Each file is written to a temporary name
+ * and renamed into place, so readers (including other programs) never see a half written thumbnail.
+ */
+void ThumbnailCache::store(const char* path, time_t mtime, int width, int height, Image* levels) {
+    char uri[PATH_MAX * 3 + 8];
+    char hash[33];
+    if (!ThumbnailCache::uri(path, uri, sizeof(uri)))
+        return;
+    ThumbnailCache::md5(uri, hash);
+
+    char mtime_text[32], width_text[16], height_text[16];
+    snprintf(mtime_text, sizeof(mtime_text), "%lld", (long long)mtime);
+    snprintf(width_text, sizeof(width_text), "%d", width);
+    snprintf(height_text, sizeof(height_text), "%d", height);
+    const char* text[][2] = {
+        {"Thumb::URI", uri},
+        {"Thumb::MTime", mtime_text},
+        {"Thumb::Image::Width", width_text},
+        {"Thumb::Image::Height", height_text},
+        {"Software", "ryi"},
+    };
+
+    for (auto& size: THUMBNAIL_CACHE_SIZES) {
+        char file[PATH_MAX];
+        if (!ThumbnailCache::directory(size.name, file, sizeof(file)))
+            return;
+        size_t length = strlen(file);
+        snprintf(file + length, sizeof(file) - length, "/%s.png", hash);
+
+        int png_size = 0;
+        unsigned char* png = ExportImageToMemory(levels[size.level], ".png", &png_size);
+        if (png == NULL || png_size < 33) {
+            MemFree(png);
+            continue;
+        }
+
+        std::vector<unsigned char> out(png, png + 33);
+        for (auto& entry: text) {
+            size_t key_length = strlen(entry[0]);
+            size_t value_length = strlen(entry[1]);
+            write_be32(out, key_length + 1 + value_length);
+            size_t start = out.size();
+            out.insert(out.end(), (const unsigned char*)"tEXt", (const unsigned char*)"tEXt" + 4);
+            out.insert(out.end(), entry[0], entry[0] + key_length + 1);
+            out.insert(out.end(), entry[1], entry[1] + value_length);
+            write_be32(out, ThumbnailCache::crc32(out.data() + start, out.size() - start));
+        }
+        out.insert(out.end(), png + 33, png + png_size);
+        MemFree(png);
+
+        char temp[PATH_MAX + 8];
+        snprintf(temp, sizeof(temp), "%s.XXXXXX", file);
+        int fd = mkstemp(temp);
+        if (fd < 0)
+            continue;
+        bool written = write(fd, out.data(), out.size()) == (ssize_t)out.size();
+        close(fd);
+        if (!written || rename(temp, file) != 0)
+            unlink(temp);
+    }
+}
+
+/*
+ * `file://` URI of the absolute path, escaped the same way GLib's g_filename_to_uri does it,
+ * otherwise the MD5 would not match what file managers write.
+ */
+bool ThumbnailCache::uri(const char* path, char* out, size_t size) {
+    char absolute[PATH_MAX];
+    if (realpath(path, absolute) == NULL)
+        return false;
+
+    const char* safe = "!$&'()*+,-./:=@_~";
+    const char* hex = "0123456789ABCDEF";
+    size_t n = snprintf(out, size, "file://");
+    for (const unsigned char* c = (const unsigned char*)absolute; *c; c++) {
+        if (n + 4 >= size)
+            return false;
+        if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || strchr(safe, *c) != NULL) {
+            out[n++] = *c;
+        } else {
+            out[n++] = '%';
+            out[n++] = hex[*c >> 4];
+            out[n++] = hex[*c & 0xf];
+        }
+    }
+    out[n] = '\0';
+    return true;
+}
+
+/*
+ * `$XDG_CACHE_HOME/thumbnails/<size_name>`, created with 0700 permissions when missing.
+ */
+bool ThumbnailCache::directory(const char* size_name, char* out, size_t size) {
+    const char* cache = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (cache != NULL && *cache == '/')
+        snprintf(out, size, "%s/thumbnails/%s", cache, size_name);
+    else if (home != NULL)
+        snprintf(out, size, "%s/.cache/thumbnails/%s", home, size_name);
+    else
+        return false;
+
+    struct stat st;
+    if (stat(out, &st) == 0)
+        return S_ISDIR(st.st_mode);
+
+    for (char* slash = strchr(out + 1, '/'); ; slash = strchr(slash + 1, '/')) {
+        if (slash != NULL) *slash = '\0';
+        bool made = mkdir(out, 0700) == 0 || errno == EEXIST;
+        if (slash == NULL) return made;
+        *slash = '/';
+        if (!made) return false;
+    }
+}
+
+unsigned int ThumbnailCache::crc32(const unsigned char* data, size_t size, unsigned int crc) {
+    static const auto table = []() {
+        std::vector<unsigned int> table(256);
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/*
+ * Plain RFC 1321 MD5, only used to name thumbnail files.
+ */
+void ThumbnailCache::md5(const char* text, char* hex) {
+    static const unsigned int K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+    };
+    static const int R[64] = {
+        7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+        5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+        4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+        6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+    };
+
+    size_t length = strlen(text);
+    std::vector<unsigned char> message(text, text + length);
+    message.push_back(0x80);
+    while (message.size() % 64 != 56)
+        message.push_back(0);
+    unsigned long long bits = (unsigned long long)length * 8;
+    for (int i = 0; i < 8; i++)
+        message.push_back(bits >> (8 * i));
+
+    unsigned int h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+        unsigned int w[16];
+        for (int i = 0; i < 16; i++) {
+            const unsigned char* p = message.data() + chunk + i * 4;
+            w[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+        }
+
+        unsigned int a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; i++) {
+            unsigned int f;
+            int g;
+            if (i < 16)      { f = (b & c) | (~b & d); g = i; }
+            else if (i < 32) { f = (d & b) | (~d & c); g = (5 * i + 1) % 16; }
+            else if (i < 48) { f = b ^ c ^ d;          g = (3 * i + 5) % 16; }
+            else             { f = c ^ (b | ~d);       g = (7 * i) % 16; }
+
+            unsigned int temp = d;
+            d = c;
+            c = b;
+            unsigned int x = a + f + K[i] + w[g];
+            b = b + ((x << R[i]) | (x >> (32 - R[i])));
+            a = temp;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    }
+
+    for (int i = 0; i < 16; i++)
+        snprintf(hex + i * 2, 3, "%02x", (h[i / 4] >> (8 * (i % 4))) & 0xff);
+}
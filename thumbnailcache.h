@@ -0,0 +1,35 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <time.h>
+#include <raylib.h>
+
+/*
+ * ThumbnailCache struct.
+ * Reads and writes thumbnails under `$XDG_CACHE_HOME/thumbnails` the way the freedesktop.org
+ * thumbnail managing standard describes it: one PNG per file, named after the MD5 of the file's
+ * URI, tagged with `Thumb::URI` and `Thumb::MTime`. The same files are used by file managers,
+ * so a directory that was browsed in one of them opens warm in ryi and the other way around.
+ * Only ever called from ImageLoader worker threads, it does blocking file IO.
+ */
+struct ThumbnailCache {
+public:
+    static bool load(const char* path, time_t mtime, Image* image, int* width, int* height);
+    static void store(const char* path, time_t mtime, int width, int height, Image* levels);
+
+private:
+    static bool uri(const char* path, char* out, size_t size);
+    static void md5(const char* text, char* hex);
+    static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0);
+    static bool directory(const char* size_name, char* out, size_t size);
+};
+
+#endif // THUMBNAILCACHE_H
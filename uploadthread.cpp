@@ -0,0 +1,167 @@
+#include "uploadthread.h"
+#include <chrono>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "pixelbuffers.h"
+#include "idle.h"
+
+// raylib links GLFW in without shipping its header, these are the few calls the shared context needs.
+extern "C" {
+typedef struct GLFWwindow GLFWwindow;
+void glfwWindowHint(int hint, int value);
+GLFWwindow* glfwCreateWindow(int width, int height, const char* title, void* monitor, GLFWwindow* share);
+void glfwDestroyWindow(GLFWwindow* window);
+void glfwMakeContextCurrent(GLFWwindow* window);
+}
+const int GLFW_FOCUSED = 0x00020001;
+const int GLFW_VISIBLE = 0x00020004;
+
+bool UploadThread::enabled = false;
+std::thread UploadThread::_thread;
+std::mutex UploadThread::_mutex;
+std::condition_variable UploadThread::_cond;
+std::deque<DecodedImage> UploadThread::_pending;
+std::deque<UploadedImage> UploadThread::_finished;
+void* UploadThread::_context = NULL;
+bool UploadThread::_running = false;
+double UploadThread::_upload_time = 0;
+size_t UploadThread::_uploads = 0;
+
+/*
+ * Creates the hidden window whose context shares textures with raylib's and starts the thread.
+ * Called on the main thread once the raylib window exists, GLFW creates windows there only.
+ * raylib's context hints are still set, the second context gets the same version and profile.
+ */
+bool UploadThread::start() {
+    if (!enabled || running())
+        return running();
+
+    glfwWindowHint(GLFW_VISIBLE, 0);
+    glfwWindowHint(GLFW_FOCUSED, 0);
+    _context = glfwCreateWindow(1, 1, "", NULL, (GLFWwindow*)GetWindowHandle());
+    glfwWindowHint(GLFW_VISIBLE, 1);
+    glfwWindowHint(GLFW_FOCUSED, 1);
+    if (_context == NULL) {
+        TraceLog(LOG_WARNING, "RYI: No shared GL context, uploading on the main thread");
+        return false;
+    }
+
+    _running = true;
+    _thread = std::thread(UploadThread::worker);
+    return true;
+}
+
+/*
+ * Stops the thread and drops what it holds. Textures that were uploaded but never taken are deleted
+ * here, they belong to both contexts.
+ */
+void UploadThread::stop() {
+    if (!running())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_all();
+    _thread.join();
+    glfwDestroyWindow((GLFWwindow*)_context);
+    _context = NULL;
+
+    for (auto& decoded: _pending)
+        UnloadImage(decoded.image);
+    _pending.clear();
+    for (auto& uploaded: _finished) {
+        UnloadTexture(uploaded.texture);
+        glDeleteSync((GLsync)uploaded.fence);
+    }
+    _finished.clear();
+}
+
+void UploadThread::push(DecodedImage& decoded) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.push_back(decoded);
+    }
+    _cond.notify_one();
+}
+
+/*
+ * Hands the next texture the GPU has finished uploading to the render loop, as an UploadTask
+ * that only has to swap it in. Returns false when none is ready yet.
+ */
+bool UploadThread::take(UploadTask& task) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_finished.empty())
+        return false;
+    auto& uploaded = _finished.front();
+    auto status = glClientWaitSync((GLsync)uploaded.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED && status != GL_WAIT_FAILED)
+        return false;
+
+    glDeleteSync((GLsync)uploaded.fence);
+    task = {.decoded = uploaded.decoded, .texture = uploaded.texture, .uploaded = true};
+    _finished.pop_front();
+    return true;
+}
+
+/*
+ * Textures uploaded but not taken yet, the render loop keeps polling their fences while there are any.
+ */
+size_t UploadThread::finished() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _finished.size();
+}
+
+/*
+ * Creates the texture of an image with every level it brings. Uncompressed images come without a chain
+ * while the thread runs, glGenerateMipmap builds it from the uploaded level.
+ */
+Texture2D UploadThread::upload(Image& image) {
+    auto texture = PixelBuffers::create_texture(image.width, image.height, image.format, image.mipmaps, (const unsigned char*)image.data);
+    if (image.mipmaps == 1 && image.format < PIXELFORMAT_COMPRESSED_DXT1_RGB && (image.width > 1 || image.height > 1)) {
+        int size = image.width > image.height ? image.width : image.height;
+        while (size > 1) {
+            size /= 2;
+            texture.mipmaps++;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.mipmaps - 1);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return texture;
+}
+
+void UploadThread::worker() {
+    glfwMakeContextCurrent((GLFWwindow*)_context);
+    while (true) {
+        DecodedImage decoded;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, []() { return !_running || !_pending.empty(); });
+            if (!_running)
+                break;
+            decoded = _pending.front();
+            _pending.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto texture = UploadThread::upload(decoded.image);
+        // The fence is flushed so the render loop's context sees it signal.
+        auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        // glTexImage2D copied the pixels, only the description is kept.
+        UnloadImage(decoded.image);
+        decoded.image.data = NULL;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished.push_back({.decoded = decoded, .texture = texture, .fence = fence});
+        Idle::wake();
+        _upload_time += elapsed.count();
+        _uploads++;
+    }
+    glfwMakeContextCurrent(NULL);
+}
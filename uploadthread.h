@@ -0,0 +1,66 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef UPLOADTHREAD_H
+#define UPLOADTHREAD_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "imageloader.h"
+
+/*
+ * UploadedImage struct.
+ * A decoded image whose texture the upload thread created, and the fence that signals once the GPU
+ * has its pixels. The Image only describes them, the pixels were freed after the upload.
+ */
+struct UploadedImage {
+    DecodedImage decoded;
+    Texture2D texture;
+    void* fence;
+};
+
+/*
+ * UploadThread struct.
+ * Uploads full images from a thread of its own, on a second GL context shared with the raylib window
+ * (a hidden GLFW window), so the render loop spends no time on them at all. The thread creates each
+ * texture, uploads it and builds its mip chain on the GPU (the workers skip the CPU chain while it runs),
+ * then fences the work. `take` hands textures whose fence signaled to the render loop, which only
+ * swaps them into their entries. Optional (`-g`): the FrameQueue path remains for everything else,
+ * passes, thumbnails and block compressed images with CPU built chains included.
+ * Needs raylib's GLFW platform, `start` fails and leaves the thread off without it.
+ */
+struct UploadThread {
+public:
+    static bool start();
+    static void stop();
+    static bool running() { return _thread.joinable(); }
+    static void push(DecodedImage& decoded);
+    static bool take(UploadTask& task);
+    static size_t finished();
+    static double upload_time() { return _uploads > 0 ? _upload_time / _uploads : 0; }
+
+    static bool enabled;
+
+private:
+    static void worker();
+    static Texture2D upload(Image& image);
+
+    static std::thread _thread;
+    static std::mutex _mutex;
+    static std::condition_variable _cond;
+    static std::deque<DecodedImage> _pending;
+    static std::deque<UploadedImage> _finished;
+    static void* _context;
+    static bool _running;
+    static double _upload_time;
+    static size_t _uploads;
+};
+
+#endif // UPLOADTHREAD_H
@@ -0,0 +1,257 @@
+#include "uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+bool Uring::enabled = false;
+
+Uring::~Uring() {
+    close();
+}
+
+bool Uring::init(unsigned int entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (m_fd < 0)
+        return false;
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        if (m_cq_ring_size > m_sq_ring_size) m_sq_ring_size = m_cq_ring_size;
+        m_cq_ring_size = m_sq_ring_size;
+    }
+
+    m_sq_ring = mmap(NULL, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sq_ring == MAP_FAILED) {
+        m_sq_ring = nullptr;
+        close();
+        return false;
+    }
+
+    m_cq_ring = single_mmap ? m_sq_ring : mmap(NULL, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED) {
+        m_cq_ring = nullptr;
+        close();
+        return false;
+    }
+
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        close();
+        return false;
+    }
+    m_sqes = (io_uring_sqe*)sqes;
+
+    auto sq = (char*)m_sq_ring;
+    m_sq_head = (unsigned int*)(sq + params.sq_off.head);
+    m_sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+    m_sq_array = (unsigned int*)(sq + params.sq_off.array);
+    m_sq_mask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+    m_sq_entries = params.sq_entries;
+    m_sq_local_tail = *m_sq_tail;
+    m_to_submit = 0;
+    m_in_flight = 0;
+
+    auto cq = (char*)m_cq_ring;
+    m_cq_head = (unsigned int*)(cq + params.cq_off.head);
+    m_cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+    m_cq_mask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    if (!probe()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Whether the kernel supports every opcode the scanner and loader submit. Kernels older than 5.6
+ * reject the probe itself.
+ */
+bool Uring::probe() {
+    const int OPS = 256;
+    size_t size = sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op);
+    auto probe = (io_uring_probe*)calloc(1, size);
+    if (probe == NULL)
+        return false;
+
+    bool supported = syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, OPS) == 0;
+    const int needed[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE};
+    for (int op: needed) {
+        if (supported && (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)))
+            supported = false;
+    }
+    free(probe);
+    return supported;
+}
+
+/*
+ * Whether rings can be set up on this kernel, checked once before `-u` turns io_uring on.
+ */
+bool Uring::supported() {
+    Uring ring;
+    return ring.init(1);
+}
+
+void Uring::close() {
+    if (m_sqes != nullptr)
+        munmap(m_sqes, m_sqes_size);
+    if (m_cq_ring != nullptr && m_cq_ring != m_sq_ring)
+        munmap(m_cq_ring, m_cq_ring_size);
+    if (m_sq_ring != nullptr)
+        munmap(m_sq_ring, m_sq_ring_size);
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_fd = -1;
+    m_sq_ring = nullptr;
+    m_cq_ring = nullptr;
+    m_sqes = nullptr;
+    m_sq_entries = 0;
+}
+
+/*
+ * The next free submission slot, or NULL when the ring is full and `submit` has to run first.
+ */
+io_uring_sqe* Uring::next_sqe() {
+    unsigned int head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sq_local_tail - head >= m_sq_entries)
+        return NULL;
+
+    unsigned int index = m_sq_local_tail & m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    m_sq_local_tail++;
+    m_to_submit++;
+    return sqe;
+}
+
+bool Uring::openat(int dir_fd, const char* path, int flags, unsigned long long user_data) {
+    auto sqe = next_sqe();
+    if (sqe == NULL) return false;
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dir_fd;
+    sqe->addr = (unsigned long long)path;
+    sqe->open_flags = flags;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool Uring::statx(int fd, const char* path, int flags, unsigned int mask, struct statx* out, unsigned long long user_data) {
+    auto sqe = next_sqe();
+    if (sqe == NULL) return false;
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)path;
+    sqe->len = mask;
+    sqe->off = (unsigned long long)out;
+    sqe->statx_flags = flags;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool Uring::read(int fd, void* buffer, unsigned int size, long long offset, unsigned long long user_data) {
+    auto sqe = next_sqe();
+    if (sqe == NULL) return false;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long long)buffer;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    return true;
+}
+
+bool Uring::close_fd(int fd, unsigned long long user_data) {
+    auto sqe = next_sqe();
+    if (sqe == NULL) return false;
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    return true;
+}
+
+/*
+ * Hands every queued operation to the kernel and blocks until at least `wait` completions are there.
+ * Returns the number of operations submitted, or -1.
+ */
+int Uring::submit(unsigned int wait) {
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+    unsigned int flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int submitted;
+    do {
+        submitted = (int)syscall(__NR_io_uring_enter, m_fd, m_to_submit, wait, flags, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted > 0) {
+        m_to_submit -= submitted;
+        m_in_flight += submitted;
+    }
+    return submitted;
+}
+
+/*
+ * Takes the oldest completion off the ring. Returns false when there is none (yet).
+ */
+bool Uring::complete(io_uring_cqe* out) {
+    unsigned int head = *m_cq_head;
+    unsigned int tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+        return false;
+
+    *out = m_cqes[head & m_cq_mask];
+    __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+    m_in_flight--;
+    return true;
+}
+
+/*
+ * Submits what is queued and waits for `count` completions, storing each result at
+ * `results[user_data]`. Every queued operation must use its index in `results` as user_data.
+ */
+bool Uring::wait_all(unsigned int count, int* results) {
+    unsigned int received = 0;
+    while (received < count) {
+        if (submit(count - received) < 0)
+            return false;
+
+        io_uring_cqe cqe;
+        while (complete(&cqe)) {
+            results[cqe.user_data] = cqe.res;
+            received++;
+        }
+    }
+    return true;
+}
+
+/*
+ * Submits whatever is still queued and waits until every operation has completed, storing results like
+ * `wait_all` when `results` is given. Buffers the operations write into may only be freed after this.
+ * When the kernel stops taking calls the ring is closed and false returned, operations may still be running then.
+ */
+bool Uring::drain(int* results) {
+    while (m_to_submit > 0 || m_in_flight > 0) {
+        int submitted = submit(m_in_flight > 0 ? 1 : 0);
+        if (submitted < 0 || (submitted == 0 && m_in_flight == 0)) {
+            close();
+            return false;
+        }
+
+        io_uring_cqe cqe;
+        while (complete(&cqe)) {
+            if (results != NULL)
+                results[cqe.user_data] = cqe.res;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+/*
+ * Ryi Image Viewer
+ *
+ * Author: Gama Sibusiso
+ * Date: 17-October-2026
+ *
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+struct statx;
+
+/*
+ * Uring struct.
+ * A minimal io_uring instance on top of the raw syscalls (no liburing): one submission and one
+ * completion ring, meant to be owned by a single thread. Callers queue a batch of operations,
+ * `submit` them together and collect the completions, so a batch costs one syscall instead of
+ * one round trip per file, which is what dominates on network storage.
+ * `init` fails on kernels without io_uring (or where it is blocked), callers then fall back to
+ * plain syscalls. It also fails on 5.1 - 5.5 kernels, which set up a ring but fail every OPENAT, STATX
+ * and READ with -EINVAL: those opcodes came with 5.6, as did the probe that asks for them.
+ */
+struct Uring {
+public:
+    ~Uring();
+
+    bool init(unsigned int entries);
+    void close();
+    bool ready() { return m_fd >= 0; }
+    unsigned int capacity() { return m_sq_entries; }
+
+    bool openat(int dir_fd, const char* path, int flags, unsigned long long user_data);
+    bool statx(int fd, const char* path, int flags, unsigned int mask, struct statx* out, unsigned long long user_data);
+    bool read(int fd, void* buffer, unsigned int size, long long offset, unsigned long long user_data);
+    bool close_fd(int fd, unsigned long long user_data);
+
+    int submit(unsigned int wait);
+    bool complete(io_uring_cqe* out);
+    bool wait_all(unsigned int count, int* results);
+    bool drain(int* results = NULL);
+
+    static bool supported();
+
+    static bool enabled;
+
+private:
+    io_uring_sqe* next_sqe();
+    bool probe();
+
+    int m_fd = -1;
+    void* m_sq_ring = nullptr;
+    void* m_cq_ring = nullptr;
+    size_t m_sq_ring_size = 0;
+    size_t m_cq_ring_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqes_size = 0;
+
+    unsigned int* m_sq_head = nullptr;
+    unsigned int* m_sq_tail = nullptr;
+    unsigned int* m_sq_array = nullptr;
+    unsigned int m_sq_mask = 0;
+    unsigned int m_sq_entries = 0;
+    unsigned int m_sq_local_tail = 0;
+    unsigned int m_to_submit = 0;
+    unsigned int m_in_flight = 0;
+
+    unsigned int* m_cq_head = nullptr;
+    unsigned int* m_cq_tail = nullptr;
+    unsigned int m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+#endif // URING_H